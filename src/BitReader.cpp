@@ -0,0 +1,25 @@
+#include "BitReader.h"
+
+#include <stdexcept>
+#include <unistd.h>
+
+const std::size_t bw::BitReader::BUFFER_SIZE;
+const unsigned bw::BitReader::MIN_BITS;
+
+void bw::BitReader::fill()
+{
+    const std::size_t left = end - p;
+    consumedBytes += p - base;
+    std::memmove(&buffer[0], p, left);
+    p = base = &buffer[0];
+    end = p + left;
+
+    while (!eof && std::size_t(end - p) < BUFFER_SIZE) {
+        const ssize_t r = ::read(fd, const_cast<unsigned char *>(end), BUFFER_SIZE - (end - p));
+        if (r < 0)
+            throw std::runtime_error("Read error");
+        if (r == 0)
+            eof = true;
+        end += r;
+    }
+}
@@ -0,0 +1,205 @@
+#ifndef _BITREADER_H_
+#define _BITREADER_H_
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+namespace bw
+{
+    // Bit input, most significant bit first, through a 64-bit accumulator.
+    // Reads either from memory or from a file descriptor in large chunks.
+    // Past the end of input zero bits are returned and overrun() turns true.
+    class BitReader {
+        public:
+            static const std::size_t BUFFER_SIZE = 1 << 16;
+            // bits guaranteed to be available after refill()
+            static const unsigned MIN_BITS = 56;
+
+        private:
+            std::uint64_t acc;          // unread bits, left aligned
+            unsigned count;             // number of unread bits in acc
+            const unsigned char *p, *end;
+            std::uint64_t padding;      // zero bits shifted in past the end
+            std::uint64_t consumedBytes;// bytes moved out of earlier chunks
+            const unsigned char *base;
+            std::vector<unsigned char> buffer;
+            int fd;
+            bool eof;
+
+        public:
+            BitReader(const BitReader &that)=delete;
+            BitReader &operator=(const BitReader &that)=delete;
+
+            // read from memory
+            BitReader(const void *data, std::size_t n)
+                :acc(0), count(0)
+                ,p(static_cast<const unsigned char *>(data)), end(p + n)
+                ,padding(0), consumedBytes(0), base(p), fd(-1), eof(true)
+            {
+            }
+
+            // read from a file descriptor
+            explicit BitReader(int _fd)
+                :acc(0), count(0), p(nullptr), end(nullptr)
+                ,padding(0), consumedBytes(0), base(nullptr), buffer(BUFFER_SIZE), fd(_fd), eof(false)
+            {
+                p = end = base = &buffer[0];
+            }
+
+            // top up the accumulator to at least MIN_BITS bits
+            void refill()
+            {
+                if (end - p < 8 && !eof)
+                    fill();
+                if (end - p >= 8) {
+                    std::uint64_t v;
+                    std::memcpy(&v, p, sizeof(v));
+                    acc |= __builtin_bswap64(v) >> count;
+                    p += (63 - count) >> 3;
+                    count |= 56;
+                    return;
+                }
+                while (count <= 56) {
+                    if (p < end)
+                        acc |= std::uint64_t(*p++) << (56 - count);
+                    else
+                        padding += 8;
+                    count += 8;
+                }
+            }
+
+            // next nbits (1..MIN_BITS) bits without consuming them; needs a refill() first
+            std::uint64_t peekBits(unsigned nbits) const
+            {
+                return acc >> (64 - nbits);
+            }
+
+            // drop nbits bits (< 64 and <= available bits)
+            void consume(unsigned nbits)
+            {
+                acc <<= nbits;
+                count -= nbits;
+            }
+
+            // read nbits (0..MIN_BITS) bits
+            std::uint64_t readBits(unsigned nbits)
+            {
+                if (nbits == 0)
+                    return 0;
+                if (count < nbits)
+                    refill();
+                const std::uint64_t v = peekBits(nbits);
+                consume(nbits);
+                return v;
+            }
+
+            bool readBit()
+            {
+                return readBits(1) != 0;
+            }
+
+            unsigned char readByte()
+            {
+                return readBits(8);
+            }
+
+            void read(void *s, std::size_t len)
+            {
+                unsigned char *q = static_cast<unsigned char *>(s);
+                for (std::size_t i = 0; i < len; i++)
+                    q[i] = readByte();
+            }
+
+            // skip to the next byte boundary
+            void align()
+            {
+                consume(count & 7);
+            }
+
+            // true once more bits were consumed than the input holds
+            bool overrun() const
+            {
+                return count < padding;
+            }
+
+            // number of bits consumed so far
+            std::uint64_t bitCount() const
+            {
+                return 8 * (consumedBytes + (p - base)) + padding - count;
+            }
+
+        private:
+            // move the unread tail of the chunk to the front and read more
+            void fill();
+    };
+
+    // The bits of one buffer in memory, read like BitReader reads them, with
+    // nothing but the read state, so that several cursors held in locals stay
+    // in registers while their streams are decoded side by side.
+    class BitCursor {
+        private:
+            std::uint64_t acc;
+            unsigned count;
+            const unsigned char *data;
+            std::size_t pos, size;
+
+        public:
+            BitCursor()
+                :acc(0), count(0), data(nullptr), pos(0), size(0)
+            {
+            }
+
+            BitCursor(const void *_data, std::size_t n)
+                :acc(0), count(0), data(static_cast<const unsigned char *>(_data)), pos(0), size(n)
+            {
+            }
+
+            // top up to at least BitReader::MIN_BITS bits, zeros past the end
+            void refill()
+            {
+                if (ahead(8)) {
+                    refillAhead();
+                    return;
+                }
+                for (; count <= 56; count += 8, pos++)
+                    if (pos < size)
+                        acc |= std::uint64_t(data[pos]) << (56 - count);
+            }
+
+            // whether n more bytes are left to be loaded
+            bool ahead(std::size_t n) const
+            {
+                return pos + n <= size;
+            }
+
+            // refill() with ahead(8) known to hold
+            void refillAhead()
+            {
+                std::uint64_t v;
+                std::memcpy(&v, data + pos, sizeof(v));
+                acc |= __builtin_bswap64(v) >> count;
+                pos += (63 - count) >> 3;
+                count |= 56;
+            }
+
+            std::uint64_t peekBits(unsigned nbits) const
+            {
+                return acc >> (64 - nbits);
+            }
+
+            void consume(unsigned nbits)
+            {
+                acc <<= nbits;
+                count -= nbits;
+            }
+
+            // true once more bits were consumed than the buffer holds
+            bool overrun() const
+            {
+                return 8 * pos > 8 * size + count;
+            }
+    };
+}
+
+#endif
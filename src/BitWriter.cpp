@@ -0,0 +1,30 @@
+#include "BitWriter.h"
+
+#include <stdexcept>
+#include <unistd.h>
+
+const std::size_t bw::BitWriter::BUFFER_SIZE;
+const unsigned bw::BitWriter::MAX_BITS;
+
+void bw::BitWriter::flush()
+{
+    align();
+    spill();
+}
+
+void bw::BitWriter::sink(const unsigned char *p, std::size_t len)
+{
+    flushed += len;
+    if (out != nullptr) {
+        out->append(reinterpret_cast<const char *>(p), len);
+        return;
+    }
+
+    while (len > 0) {
+        const ssize_t w = ::write(fd, p, len);
+        if (w < 0)
+            throw std::runtime_error("Write error");
+        p += w;
+        len -= w;
+    }
+}
@@ -0,0 +1,135 @@
+#ifndef _BITWRITER_H_
+#define _BITWRITER_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+namespace bw
+{
+    // Bit output, most significant bit first, through a 64-bit accumulator.
+    // Whole bytes are staged in a buffer that is flushed in large writes
+    // either to a byte string or to a file descriptor.
+    class BitWriter {
+        public:
+            static const std::size_t BUFFER_SIZE = 1 << 16;
+            // widest value a single writeBits() accepts
+            static const unsigned MAX_BITS = 57;
+
+        private:
+            std::uint64_t acc;      // pending bits, left aligned
+            unsigned count;         // number of pending bits
+            std::vector<unsigned char> buffer;
+            std::size_t pos;
+            std::uint64_t flushed;  // bytes already handed to the sink
+            std::string *out;
+            int fd;
+
+        public:
+            BitWriter(const BitWriter &that)=delete;
+            BitWriter &operator=(const BitWriter &that)=delete;
+
+            // append to a byte string
+            explicit BitWriter(std::string &_out)
+                :acc(0), count(0), buffer(BUFFER_SIZE + 8), pos(0), flushed(0), out(&_out), fd(-1)
+            {
+            }
+
+            // write to a file descriptor
+            explicit BitWriter(int _fd)
+                :acc(0), count(0), buffer(BUFFER_SIZE + 8), pos(0), flushed(0), out(nullptr), fd(_fd)
+            {
+            }
+
+            // flushes what is left; call flush() first to see errors
+            ~BitWriter()
+            {
+                try {
+                    flush();
+                }
+                catch (...) {
+                }
+            }
+
+            // write the nbits (<= MAX_BITS) low bits of value
+            void writeBits(std::uint64_t value, unsigned nbits)
+            {
+                if (nbits == 0)
+                    return;
+                if (count + nbits > 64)
+                    drain();
+                acc |= (value << (64 - nbits)) >> count;
+                count += nbits;
+            }
+
+            void write(bool bit)
+            {
+                writeBits(bit, 1);
+            }
+
+            void writeByte(unsigned char c)
+            {
+                writeBits(c, 8);
+            }
+
+            void write(const void *s, std::size_t len)
+            {
+                const unsigned char *p = static_cast<const unsigned char *>(s);
+                if (count % 8 == 0) {
+                    drain();
+                    if (pos + len > BUFFER_SIZE)
+                        spill();
+                    if (len >= BUFFER_SIZE) {
+                        sink(p, len);
+                        return;
+                    }
+                    std::memcpy(&buffer[pos], p, len);
+                    pos += len;
+                    return;
+                }
+                for (std::size_t i = 0; i < len; i++)
+                    writeBits(p[i], 8);
+            }
+
+            // pad with zero bits up to the next byte boundary
+            void align()
+            {
+                count = (count + 7) & ~7u;
+                drain();
+            }
+
+            // align and hand every byte to the sink
+            void flush();
+
+            // number of bits written so far, including padding from align()
+            std::uint64_t bitCount() const
+            {
+                return 8 * (flushed + pos) + count;
+            }
+
+        private:
+            // move the whole bytes of the accumulator into the buffer
+            void drain()
+            {
+                const std::uint64_t v = __builtin_bswap64(acc);
+                std::memcpy(&buffer[pos], &v, sizeof(v));
+                pos += count >> 3;
+                acc = (count & ~7u) == 64 ? 0 : acc << (count & ~7u);
+                count &= 7;
+                if (pos >= BUFFER_SIZE)
+                    spill();
+            }
+
+            // flush the buffer to the sink
+            void spill()
+            {
+                sink(&buffer[0], pos);
+                pos = 0;
+            }
+
+            void sink(const unsigned char *p, std::size_t len);
+    };
+}
+
+#endif
@@ -1,3 +1,4 @@
 // the configured options and settings for Burrows-Wheeler
 #define BW_VERSION_MAJOR 1
 #define BW_VERSION_MINOR 0
+#define BW_STATS 1
@@ -1 +1,8 @@
 #include "BurrowsWheeler.h"
+
+const std::size_t bw::BurrowsWheeler::MIN_BLOCK_SIZE;
+const std::size_t bw::BurrowsWheeler::MAX_BLOCK_SIZE;
+const unsigned bw::BurrowsWheeler::MAX_CHAINS;
+const std::size_t bw::BurrowsWheeler::MAGIC_SIZE;
+const char bw::BurrowsWheeler::BLOCK_MAGIC[] = { 'B', 'W', 'T', 'B' };
+const char bw::BurrowsWheeler::WHOLE_MAGIC[] = { 'B', 'W', 'T', 'W' };
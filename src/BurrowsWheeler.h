@@ -2,9 +2,11 @@
 #define _BURROWSWHEELER_H_
 
 #include <string>
+#include <cstring>
+#include <stdexcept>
 #include <sstream>
 #include <vector>
-#include <queue>
+#include <cstdint>
 #include <iostream>
 
 #include "CircularSuffixArray.h"
@@ -12,93 +14,255 @@
 namespace bw
 {
     class BurrowsWheeler {
-        // apply Burrows-Wheeler encoding, reading from standard input and writing to standard output
-        private:
-            class Item
+        public:
+            // bounds of the block size accepted by the blocked container
+            static const std::size_t MIN_BLOCK_SIZE = 100 << 10;
+            static const std::size_t MAX_BLOCK_SIZE = 64 << 20;
+
+            // most independent chains the inverse follows at once
+            static const unsigned MAX_CHAINS = 8;
+
+            // apply the transform to one block; returns the row of the original string
+            std::uint64_t static transform(const std::string &block, std::string &out,
+                    CircularSuffixArray::Algorithm algorithm = CircularSuffixArray::SAIS)
             {
-                private:
-                    std::queue<int> q;
-                    int count;
-
-                public:
-                    Item()
-                        :count(0)
-                    {
-                    }
+                std::vector<std::uint64_t> starts;
+                transform(block, out, starts, 1, algorithm);
+                return starts.empty() ? 0 : starts[0];
+            }
 
-                    void inc() { count++; }
-                    int getCount() { return count; }
-                    void enqueue(int v) { q.push(v); }
-                    int dequeue() {
-                        int f = q.front(); q.pop();
-                        return f;
-                    }
-            };
+            // apply the transform to one block, split into at most `chains` (<= MAX_CHAINS)
+            // equal pieces; starts[j] is the row of the rotation at the start of piece j,
+            // starts[0] being the row of the original string
+            void static transform(const std::string &block, std::string &out, std::vector<std::uint64_t> &starts,
+                    unsigned chains, CircularSuffixArray::Algorithm algorithm = CircularSuffixArray::SAIS)
+            {
+                transform(block.data(), block.size(), out, starts, chains, algorithm);
+            }
 
-            typedef std::unique_ptr<Item> Item_uptr;
+            // same on block[0..n), e.g. a piece of a mapped file
+            void static transform(const char *block, std::size_t n, std::string &out, std::vector<std::uint64_t> &starts,
+                    unsigned chains, CircularSuffixArray::Algorithm algorithm = CircularSuffixArray::SAIS)
+            {
+                if (chains == 0 || chains > MAX_CHAINS)
+                    throw std::invalid_argument("Invalid number of chains");
 
-        public:
-            void static encode(std::istream &streamin, std::ostream &streamout)
+                const CircularSuffixArray cas(block, n, algorithm);
+                transform(cas, block, n, out, starts, chains);
+            }
+
+            // same given the circular suffix array of block[0..n), for callers
+            // that need the sorted rotations for more than the transform
+            void static transform(const CircularSuffixArray &cas, const char *block, std::size_t n,
+                    std::string &out, std::vector<std::uint64_t> &starts, unsigned chains)
+            {
+                if (chains == 0 || chains > MAX_CHAINS)
+                    throw std::invalid_argument("Invalid number of chains");
+                if (cas.length() != n)
+                    throw std::invalid_argument("Suffix array of another block");
+
+                BW_STATS_TIMER(timer, BWT, n);
+                BW_STATS_OUTPUT(timer, n);
+                const std::size_t piece = chainLength(n, chains);
+
+                starts.assign(piece ? (n + piece - 1) / piece : 0, 0);
+                out.resize(n);
+                for (std::size_t i = 0; i < n; i++)
+                {
+                    const std::size_t p = cas.index(i);
+                    if (p % piece == 0)
+                        starts[p / piece] = i;
+                    out[i] = block[(p ? p : n) - 1];
+                }
+            }
+
+            // invert the transform of one block given the row of the original string
+            void static inverse(std::uint64_t first, const std::string &in, std::string &out)
+            {
+                const std::vector<std::uint64_t> starts(in.empty() ? 0 : 1, first);
+                inverse(starts, in, out);
+            }
+
+            // invert the transform of one block given the rows written by transform();
+            // the pieces are decoded side by side so their cache misses overlap
+            void static inverse(const std::vector<std::uint64_t> &starts, const std::string &in, std::string &out)
+            {
+                const std::size_t n = in.size();
+                if (starts.size() > MAX_CHAINS || (n == 0) != starts.empty()
+                        || (n && starts.size() != (n + chainLength(n, starts.size()) - 1) / chainLength(n, starts.size())))
+                    throw std::runtime_error("Corrupted block header");
+                for (unsigned j = 0; j < starts.size(); j++)
+                    if (starts[j] >= n)
+                        throw std::runtime_error("Corrupted block header");
+
+                BW_STATS_TIMER(timer, BWT_INVERSE, n);
+                BW_STATS_OUTPUT(timer, n);
+                out.resize(n);
+                if (n == 0)
+                    return;
+                // symbol and successor share one word: 32 bits while the index fits 24 bits
+                if (n <= (1u << 24))
+                    invert<std::uint32_t>(starts, in, out);
+                else
+                    invert<std::uint64_t>(starts, in, out);
+            }
+
+            // apply Burrows-Wheeler encoding to the whole input as one block.
+            // Layout: WHOLE_MAGIC, the first row as 64 bits, then the transformed bytes.
+            void static encode(std::istream &streamin, std::ostream &streamout,
+                    CircularSuffixArray::Algorithm algorithm = CircularSuffixArray::SAIS)
             {
                 std::istreambuf_iterator<char> eos;
                 std::string buffer(std::istreambuf_iterator<char>(streamin), eos);
-                std::stringstream bufferb;
+                std::string bufferb;
+
+                const std::uint64_t first = transform(buffer, bufferb, algorithm);
+
+                streamout.write(WHOLE_MAGIC, MAGIC_SIZE);
+                streamout.write(reinterpret_cast<const char *>(&first), sizeof(first));
+                streamout.write(bufferb.data(), bufferb.size());
+                streamout.flush();
+            }
 
-                CircularSuffixArray cas(buffer);
-                int first = 0;
+            // apply Burrows-Wheeler encoding block by block, so that memory is bounded
+            // by blockSize and each block is written as soon as it is transformed.
+            // Layout: BLOCK_MAGIC, then for each block its length, its first row and
+            // its transformed bytes, both 32 bits as blocks are at most MAX_BLOCK_SIZE.
+            void static encode(std::istream &streamin, std::ostream &streamout, std::size_t blockSize,
+                    CircularSuffixArray::Algorithm algorithm = CircularSuffixArray::SAIS)
+            {
+                if (blockSize == 0 || blockSize > MAX_BLOCK_SIZE)
+                    throw std::invalid_argument("Invalid block size");
+                std::string block, bufferb;
 
-                for (unsigned i = 0; i < buffer.size(); i++)
+                streamout.write(BLOCK_MAGIC, MAGIC_SIZE);
+                for (;;)
                 {
-                    if (cas.index(i) == 0)
-                        first = i;
-                    bufferb.put(buffer.at((buffer.length() + cas.index(i) - 1) % buffer.length()));
+                    block.resize(blockSize);
+                    streamin.read(&block[0], blockSize);
+                    if (streamin.gcount() <= 0)
+                        break;
+                    block.resize(streamin.gcount());
+
+                    const std::uint32_t len = block.size();
+                    const std::uint32_t first = transform(block, bufferb, algorithm);
+
+                    streamout.write(reinterpret_cast<const char *>(&len), sizeof(len));
+                    streamout.write(reinterpret_cast<const char *>(&first), sizeof(first));
+                    streamout.write(bufferb.data(), bufferb.size());
+                    streamout.flush();
                 }
-               streamout.write(reinterpret_cast<const char *>(&first), sizeof(first));
-               streamout << bufferb.rdbuf();
-               streamout.flush();
+                streamout.flush();
             }
 
-            // apply Burrows-Wheeler decoding, reading from standard input and writing to standard output
+            // apply Burrows-Wheeler decoding, reading from standard input and writing to standard output.
+            // Both the single block and the blocked layout are accepted.
             void static decode(std::istream &streamin, std::ostream &streamout)
             {
-                Item_uptr pos[256];
+                char magic[MAGIC_SIZE];
+                if (!streamin.read(magic, MAGIC_SIZE))
+                    return;
 
-                int first, len, m = 0, i = 0;
-                streamin.read(reinterpret_cast<char *>(&first), sizeof(first));
+                if (std::memcmp(magic, BLOCK_MAGIC, MAGIC_SIZE) == 0)
+                {
+                    decodeBlocks(streamin, streamout);
+                    return;
+                }
+                if (std::memcmp(magic, WHOLE_MAGIC, MAGIC_SIZE) != 0)
+                    throw std::runtime_error("Not a Burrows-Wheeler stream");
 
-                i = 0;
-                m = 0;
+                std::uint64_t first;
+                if (!streamin.read(reinterpret_cast<char *>(&first), sizeof(first)))
+                    throw std::runtime_error("Truncated block header");
 
-                char c;
-                while (streamin.get(c)) {
-                    const unsigned char d(c);
-                    if (pos[d] == nullptr)
-                        pos[d] = Item_uptr(new Item());
-                    pos[d]->inc();
-                    pos[d]->enqueue(i++);
-                }
+                std::istreambuf_iterator<char> eos;
+                std::string buffer(std::istreambuf_iterator<char>(streamin), eos);
+                std::string bufferb;
 
-                std::vector<int> next(i);
-                std::vector<unsigned char> sorted(i);
+                inverse(first, buffer, bufferb);
+                streamout.write(bufferb.data(), bufferb.size());
+                streamout.flush();
+            }
 
-                len = i;
-                i = 0;
+        private:
+            // length of each piece when n symbols are split into at most `chains` pieces
+            std::size_t static chainLength(std::size_t n, std::size_t chains)
+            {
+                return chains ? (n + chains - 1) / chains : 0;
+            }
 
+            // LF-mapping over a counting sort of the last column: word k holds the
+            // last column symbol of row k in its low 8 bits and, above them, the row
+            // that follows the k-th row of the sorted first column in the text
+            template <typename Word>
+            void static invert(const std::vector<std::uint64_t> &starts, const std::string &in, std::string &out)
+            {
+                const std::size_t n = in.size();
+                const unsigned char *l = reinterpret_cast<const unsigned char *>(in.data());
+                std::vector<Word> t(n);
 
-                for (int j = 0; j < 256; ++j)
-                    for (int k = 0; pos[j] != nullptr && k < pos[j]->getCount(); ++k)
-                    {
-                        next[i] = pos[j]->dequeue();
-                        sorted[i] = j;
-                        i++;
+                std::size_t next[256];
+                std::memset(next, 0, sizeof(next));
+                for (std::size_t i = 0; i < n; i++) {
+                    next[l[i]]++;
+                    t[i] = l[i];
+                }
+                for (std::size_t c = 0, sum = 0; c < 256; c++) {
+                    const std::size_t count = next[c];
+                    next[c] = sum;
+                    sum += count;
+                }
+                for (std::size_t i = 0; i < n; i++)
+                    t[next[l[i]]++] |= Word(i) << 8;
+
+                // every chain walks its own piece; the shortest length is walked in lockstep
+                const unsigned chains = starts.size();
+                const std::size_t piece = chainLength(n, chains);
+                const Word *__restrict tt = t.data();
+                unsigned char *__restrict o = reinterpret_cast<unsigned char *>(&out[0]);
+                Word pos[MAX_CHAINS];
+                for (unsigned j = 0; j < chains; j++)
+                    pos[j] = tt[starts[j]] >> 8;
+
+                const std::size_t lockstep = n - (chains - 1) * piece;
+                for (std::size_t m = 0; m < lockstep; m++)
+                    for (unsigned j = 0; j < chains; j++) {
+                        const Word w = tt[pos[j]];
+                        o[j * piece + m] = w;
+                        pos[j] = w >> 8;
+                    }
+                for (std::size_t m = lockstep; m < piece; m++)
+                    for (unsigned j = 0; j + 1 < chains; j++) {
+                        const Word w = tt[pos[j]];
+                        o[j * piece + m] = w;
+                        pos[j] = w >> 8;
                     }
+            }
+
+            // leading bytes of the blocked and of the single block layouts
+            static const std::size_t MAGIC_SIZE = 4;
+            static const char BLOCK_MAGIC[];
+            static const char WHOLE_MAGIC[];
 
-                i = first;
-                do {
-                    streamout.put(sorted[i]);
-                    i = next[i];
-                } while (++m < len);
+            void static decodeBlocks(std::istream &streamin, std::ostream &streamout)
+            {
+                std::string block, bufferb;
+                std::uint32_t len, first;
 
+                while (streamin.read(reinterpret_cast<char *>(&len), sizeof(len)))
+                {
+                    if (!streamin.read(reinterpret_cast<char *>(&first), sizeof(first)))
+                        throw std::runtime_error("Truncated block header");
+                    if (len > MAX_BLOCK_SIZE || (len && first >= len))
+                        throw std::runtime_error("Corrupted block header");
+
+                    block.resize(len);
+                    if (!streamin.read(&block[0], len))
+                        throw std::runtime_error("Truncated block");
+
+                    inverse(first, block, bufferb);
+                    streamout.write(bufferb.data(), bufferb.size());
+                }
                 streamout.flush();
             }
     };
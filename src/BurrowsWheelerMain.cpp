@@ -1,10 +1,12 @@
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <chrono>
 #include <getopt.h>
 
 #include "shared.h"
 #include "BurrowsWheeler.h"
+#include "Stats.h"
 
 namespace
 {
@@ -18,7 +20,10 @@ void usage() {
     std::fprintf(stderr, "-h/--help: Emit help menu\n"
                          "-e/--encode: Encode\n"
                          "-d/--decode: Decode\n"
-                         "-x/--hexdump: Emit in hex format\n");
+                         "-s/--sort: Suffix sorting engine for encoding: sais (default), quick3 or parallel\n"
+                         "-b/--block-size: Encode in independent blocks of this size (100k-64M)\n"
+                         "-x/--hexdump: Emit in hex format\n"
+                         "--stats[=json]: Print per-stage statistics to standard error\n");
 }
 
 int main(int argc, char** argv)
@@ -32,15 +37,47 @@ int main(int argc, char** argv)
           {"encode",   no_argument,      0, 'e'},
           {"decode",   no_argument,      0, 'd'},
           {"hexdump",   no_argument,     0, 'x'},
+          {"block-size", required_argument, 0, 'b'},
+          {"sort",     required_argument, 0, 's'},
+          {"stats",    optional_argument, 0, 'S'},
           {0, 0, 0, 0}
         };
     int option_index;
     bool use_hex(false), encode(false), decode(false);
-    while((c = getopt_long(argc, argv, "hexd", long_options, &option_index)) >= 0) {
+    bool stats(false), stats_json(false);
+    std::size_t block_size(0);
+    bw::CircularSuffixArray::Algorithm algorithm(bw::CircularSuffixArray::SAIS);
+    while((c = getopt_long(argc, argv, "hexdb:s:", long_options, &option_index)) >= 0) {
         switch(c) {
             case 'e': encode  = true; break;
+            case 'b':
+                block_size = bw::parseSize(optarg);
+                if (block_size < bw::BurrowsWheeler::MIN_BLOCK_SIZE || block_size > bw::BurrowsWheeler::MAX_BLOCK_SIZE) {
+                    std::fprintf(stderr, "Invalid block size '%s': expected 100k to 64M\n", optarg);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
+            case 's':
+                if (std::strcmp(optarg, "sais") == 0)
+                    algorithm = bw::CircularSuffixArray::SAIS;
+                else if (std::strcmp(optarg, "quick3") == 0)
+                    algorithm = bw::CircularSuffixArray::QUICK3;
+                else if (std::strcmp(optarg, "parallel") == 0)
+                    algorithm = bw::CircularSuffixArray::PARALLEL;
+                else {
+                    std::fprintf(stderr, "Unknown sorting engine '%s'\n", optarg);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
             case 'd': decode  = true; break;
             case 'x': use_hex = true; break;
+            case 'S':
+                stats = true;
+                if (!bw::parseStatsFormat(optarg, stats_json)) {
+                    std::fprintf(stderr, "Invalid statistics format '%s': expected text or json\n", optarg);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
             case 'h':
                 std::cout << "Move to front command line tool" << std::endl <<
                     "Usage: " << basename(argv[0]) << " [-h+-] [-x]" << std::endl;
@@ -49,13 +86,17 @@ int main(int argc, char** argv)
         }
     }
 
+    const auto start = std::chrono::steady_clock::now();
     if (encode)
     {
         if (use_hex)
         {
             std::stringstream sout;
-            bw::BurrowsWheeler::encode(std::cin, sout);
-            int bytes = 0;
+            if (block_size)
+                bw::BurrowsWheeler::encode(std::cin, sout, block_size, algorithm);
+            else
+                bw::BurrowsWheeler::encode(std::cin, sout, algorithm);
+            std::uint64_t bytes = 0;
             char c;
             while (sout.get(c))
             {
@@ -66,9 +107,13 @@ int main(int argc, char** argv)
             std::cout.clear();
             std::cout << std::endl << std::dec << bytes * 8 << " bits" << std::endl;
         }
+        else if (block_size)
+        {
+            bw::BurrowsWheeler::encode(std::cin, std::cout, block_size, algorithm);
+        }
         else
         {
-            bw::BurrowsWheeler::encode(std::cin, std::cout);
+            bw::BurrowsWheeler::encode(std::cin, std::cout, algorithm);
         }
     }
 
@@ -77,6 +122,11 @@ int main(int argc, char** argv)
         bw::BurrowsWheeler::decode(std::cin, std::cout);
     }
 
+    if (stats) {
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        bw::Stats::report(stderr, stats_json, elapsed.count());
+    }
+
     return SUCCESS;
 
 } // main
@@ -1 +1,5 @@
 #include "CircularSuffixArray.h"
+
+const std::uint64_t bw::CircularSuffixArray::COMPACT_SIZE;
+const unsigned bw::CircularSuffixArray::WIDE_BYTES;
+const std::uint64_t bw::CircularSuffixArray::SAIS_NARROW_SIZE;
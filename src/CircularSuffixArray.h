@@ -6,52 +6,199 @@
 #include <memory>
 #include <stdexcept>
 #include <numeric>
+#include <cstdint>
 #include "Quick3stringEx.h"
+#include "Sais.h"
+#include "ParallelSuffixSort.h"
+#include "ThreadPool.h"
+#include "Stats.h"
 
 namespace bw {
     class CircularSuffixArray {
+        public:
+            // suffix sorting engine
+            enum Algorithm {
+                SAIS,       // linear time induced sorting (default)
+                QUICK3,     // 3-way radix quicksort over the doubled string
+                PARALLEL    // ParallelSuffixSort: radix buckets sorted on several threads
+            };
+
+        private:
             std::size_t len;
-            std::vector<int> idx;
-            std::string b;
+            std::vector<std::uint32_t> idx;     // the array while its indices fit 32 bits
+            std::vector<unsigned char> wide;    // WIDE_BYTES per index otherwise
+            const char *b;          // the input, not copied; it must outlive the array
+
+            // longest input whose indices fit idx
+            static const std::uint64_t COMPACT_SIZE = std::uint64_t(1) << 32;
+            // bytes per index above COMPACT_SIZE: 40 bits, up to 1 TB
+            static const unsigned WIDE_BYTES = 5;
+            // longest input sorted with 32-bit signed indices by SA-IS
+            static const std::uint64_t SAIS_NARROW_SIZE = INT32_MAX;
 
         public:
-            CircularSuffixArray(const std::string &s)  // circular suffix array of s
-                :len(s.size())
-                ,idx(len)
+            CircularSuffixArray(const std::string &s, Algorithm algorithm = SAIS)  // circular suffix array of s
+                :CircularSuffixArray(s.data(), s.size(), algorithm)
             {
-                b.reserve(len << 1);
-                b += s; b += s;
-                std::iota(idx.begin(), idx.end(), 0);
-
-                Quick3stringEx quick3Str;
-
-                quick3Str.sort(idx, b);
+            }
+            // threads is only used by PARALLEL; 0 stands for every hardware thread
+            // and more than that are not used. On a single thread SA-IS is faster.
+            CircularSuffixArray(const char *s, std::size_t n, Algorithm algorithm = SAIS, unsigned threads = 0)
+                :len(n)
+                ,b(s)
+            {
+                if (std::uint64_t(n) >> (8 * WIDE_BYTES))
+                    throw std::length_error("Input too large for a suffix array");
+                BW_STATS_TIMER(timer, SUFFIX_SORT, n);
+                BW_STATS_OUTPUT(timer, n * (compact() ? sizeof(std::uint32_t) : WIDE_BYTES));
+                // Quick3stringEx and ParallelSuffixSort sort 32-bit offsets, so
+                // larger inputs take SA-IS
+                const unsigned cores = ThreadPool::hardwareThreads();
+                const unsigned sorters = threads == 0 || threads > cores ? cores : threads;
+                if (algorithm == QUICK3 && compact())
+                    sortQuick3();
+                else if (algorithm != PARALLEL || sorters < 2 || len >= COMPACT_SIZE || !sortParallel(sorters))
+                    sortSais();
             }
             std::size_t length() const           // length of s
             {
                 return len;
             }
-            int index(int i) const          // returns index of ith sorted suffix
+            std::size_t index(std::size_t i) const          // returns index of ith sorted suffix
             {
 #if !NDEBUG
-                return idx.at(i);
-#else
-                return idx[i];
+                if (i >= len)
+                    throw std::out_of_range("CircularSuffixArray::index");
 #endif
+                if (compact())
+                    return idx[i];
+                const unsigned char *p = &wide[i * WIDE_BYTES];
+                std::uint64_t v = 0;
+                for (unsigned k = 0; k < WIDE_BYTES; k++)
+                    v |= std::uint64_t(p[k]) << (8 * k);
+                return v;
             }
-            std::string strIndex(int i) const     // return string on index by copying
+            std::string strIndex(std::size_t i) const     // return string on index by copying
             {
-                return b.substr(index(i), len + index(i));
+                return std::string(b + index(i), b + len) + std::string(b, b + index(i));
             }
             void clear() {
                 {
-                    std::vector<int> tmp;
+                    std::vector<std::uint32_t> tmp;
                     std::swap(tmp, idx);
                 }
-                {
-                    std::string tmp;
-                    std::swap(b, tmp);
+                std::vector<unsigned char>().swap(wide);
+                b = nullptr;
+            }
+
+        private:
+            bool compact() const
+            {
+                return len <= COMPACT_SIZE;
+            }
+
+            void sortQuick3()
+            {
+                std::string d;
+                d.reserve(len << 1);
+                d.append(b, len); d.append(b, len);
+                idx.resize(len);
+                std::iota(idx.begin(), idx.end(), 0);
+
+                Quick3stringEx::sort(idx, d);
+            }
+
+            // Identical rotations are put in the order sortSais() gives them, so
+            // that the transform does not depend on the engine: as suffixes of
+            // the least rotation, the later one first. False if the input is
+            // too repetitive, see ParallelSuffixSort::sort().
+            bool sortParallel(unsigned threads)
+            {
+                idx.resize(len);
+                std::vector<ParallelSuffixSort::Group> ties;
+                if (!ParallelSuffixSort::sort(reinterpret_cast<const unsigned char *>(b), len, idx.data(), threads, ties))
+                    return false;
+                if (ties.empty())
+                    return true;
+                const std::size_t r = leastRotation();
+                for (const ParallelSuffixSort::Group &g : ties)
+                    std::sort(idx.begin() + g.first, idx.begin() + g.second, [&](std::uint32_t x, std::uint32_t y) {
+                        return (x + len - r) % len > (y + len - r) % len;
+                    });
+                return true;
+            }
+
+            // Rotations are sorted as the suffixes of the least rotation of s: for
+            // a Lyndon word (or a power of one) suffix order and rotation order agree,
+            // so no doubling of the input is needed.
+            void sortSais()
+            {
+                if (len == 0)
+                    return;
+
+                const std::size_t r = leastRotation();
+                std::string w;
+                w.reserve(len);
+                w.append(b + r, len - r);
+                w.append(b, r);
+                const unsigned char *u = reinterpret_cast<const unsigned char *>(w.data());
+
+                if (len <= SAIS_NARROW_SIZE) {
+                    idx.resize(len);
+                    std::int32_t *sa = reinterpret_cast<std::int32_t *>(idx.data());
+                    Sais::sort(u, sa, std::int32_t(len), std::int32_t(255));
+                    for (std::size_t i = 0; i < len; i++)
+                        idx[i] = unrotate(sa[i], r);
+                    return;
+                }
+
+                // sort with 64-bit indices, then keep them at the compact width
+                std::vector<std::int64_t> sa(len);
+                Sais::sort(u, sa.data(), std::int64_t(len), std::int64_t(255));
+                std::string().swap(w);
+                if (compact()) {
+                    idx.resize(len);
+                    for (std::size_t i = 0; i < len; i++)
+                        idx[i] = unrotate(sa[i], r);
+                    return;
+                }
+                wide.resize(len * WIDE_BYTES);
+                for (std::size_t i = 0; i < len; i++) {
+                    const std::uint64_t v = unrotate(sa[i], r);
+                    for (unsigned k = 0; k < WIDE_BYTES; k++)
+                        wide[i * WIDE_BYTES + k] = v >> (8 * k);
+                }
+            }
+
+            // position in b of the suffix at p of the rotation starting at r
+            std::size_t unrotate(std::size_t p, std::size_t r) const
+            {
+                p += r;
+                return p >= len ? p - len : p;
+            }
+
+            // start of the lexicographically least rotation of b, in linear time
+            std::size_t leastRotation() const
+            {
+                const unsigned char *s = reinterpret_cast<const unsigned char *>(b);
+                std::size_t i = 0, j = 1, k = 0;
+                while (i < len && j < len && k < len) {
+                    std::size_t ik = i + k, jk = j + k;
+                    const unsigned char x = s[ik >= len ? ik - len : ik];
+                    const unsigned char y = s[jk >= len ? jk - len : jk];
+                    if (x == y) {
+                        k++;
+                        continue;
+                    }
+                    if (x > y)
+                        i += k + 1;
+                    else
+                        j += k + 1;
+                    if (i == j)
+                        j++;
+                    k = 0;
                 }
+                return i < j ? i : j;
             }
     };
 }
@@ -0,0 +1,1045 @@
+#include "Compressor.h"
+
+#include <fstream>
+#include <deque>
+#include <future>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "BurrowsWheeler.h"
+#include "MoveToFront.h"
+#include "ZeroRunLength.h"
+#include "Huffman.h"
+#include "Rans.h"
+#include "BitWriter.h"
+#include "BitReader.h"
+#include "ThreadPool.h"
+#include "Pipeline.h"
+#include "MappedFile.h"
+#include "FileWriter.h"
+#include "Stats.h"
+#include "Crc32c.h"
+#include "FmIndex.h"
+#include "CircularSuffixArray.h"
+
+namespace
+{
+    const char MAGIC[] = { 'B', 'W', 'C' };
+    const char INDEX_MAGIC[] = { 'B', 'W', 'C', 'I' };
+    // bumped whenever the layout of the container or of a packed block changes
+    const unsigned char VERSION = 8;
+    const std::size_t HEADER_SIZE = bw::Compressor::HEADER_SIZE;
+    static_assert(HEADER_SIZE == sizeof(MAGIC) + 1 + sizeof(std::uint32_t), "header layout");
+    static_assert(bw::Compressor::MAX_PACKED_SIZE >= 2 * bw::BurrowsWheeler::MAX_BLOCK_SIZE, "packed size bound");
+    const std::size_t TRAILER_SIZE = sizeof(std::uint64_t) + sizeof(INDEX_MAGIC);
+    const std::size_t ENTRY_SIZE = 2 * sizeof(std::uint64_t) + 2 * sizeof(std::uint32_t);
+    // blocks read ahead of the workers, and buffers waiting for the writer
+    const std::size_t READ_AHEAD = 2;
+    const std::size_t WRITE_BEHIND = 4;
+
+    template <typename Sink, typename T>
+    void put(Sink &streamout, const T &v)
+    {
+        streamout.write(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+
+    template <typename T>
+    bool get(std::istream &streamin, T &v)
+    {
+        return bool(streamin.read(reinterpret_cast<char *>(&v), sizeof(v)));
+    }
+
+    // read up to n bytes into block, returns false at end of input
+    bool readBlock(std::istream &streamin, std::string &block, std::size_t n)
+    {
+        block.resize(n);
+        streamin.read(&block[0], n);
+        if (streamin.gcount() <= 0)
+            return false;
+        block.resize(streamin.gcount());
+        return true;
+    }
+
+    // hand a packed block to the writer, timed there
+    template <typename Sink>
+    void writeBlock(bw::WriteBehind<Sink> &streamout, unsigned rawSize, std::string packed)
+    {
+        const unsigned packedSize = packed.size();
+        put(streamout, rawSize);
+        put(streamout, packedSize);
+        streamout.write(std::move(packed));
+    }
+
+    // check magic and version
+    void readHeader(std::istream &streamin)
+    {
+        char header[HEADER_SIZE];
+        streamin.read(header, sizeof(header));
+        bw::Compressor::checkHeader(header, streamin.gcount());
+    }
+
+    bool preadFully(int fd, void *buf, std::size_t n, std::uint64_t offset)
+    {
+        char *p = static_cast<char *>(buf);
+        while (n > 0) {
+            const ssize_t r = ::pread(fd, p, n, offset);
+            if (r <= 0)
+                return false;
+            p += r;
+            n -= r;
+            offset += r;
+        }
+        return true;
+    }
+
+    // a block of input: a view of a mapped file, or a buffer it owns
+    struct Chunk {
+        const char *data;
+        std::size_t size;
+        std::uint64_t offset;
+        std::shared_ptr<std::string> owner;
+    };
+
+    // blocks read from a stream
+    class StreamSource {
+        private:
+            std::istream &streamin;
+            std::size_t blockSize;
+            std::uint64_t offset;
+        public:
+            StreamSource(std::istream &_streamin, std::size_t _blockSize)
+                :streamin(_streamin), blockSize(_blockSize), offset(0)
+            {
+            }
+            bool next(Chunk &chunk)
+            {
+                std::shared_ptr<std::string> block(new std::string());
+                if (!readBlock(streamin, *block, blockSize))
+                    return false;
+                const Chunk c = { block->data(), block->size(), offset, block };
+                offset += c.size;
+                chunk = c;
+                return true;
+            }
+            void done(const Chunk &) const
+            {
+            }
+            // a block is read by next() already
+            void load(const Chunk &) const
+            {
+            }
+            // number of blocks, 0 when not known in advance
+            std::uint64_t blocks() const
+            {
+                return 0;
+            }
+    };
+
+    // blocks viewed in place in memory; the pages of a mapped file are dropped
+    // once compressed
+    class MemorySource {
+        private:
+            const char *data;
+            std::uint64_t size;
+            std::size_t blockSize;
+            std::uint64_t offset;
+            const bw::MappedFile *file;
+        public:
+            MemorySource(const char *_data, std::uint64_t _size, std::size_t _blockSize,
+                    const bw::MappedFile *_file = nullptr)
+                :data(_data), size(_size), blockSize(_blockSize), offset(0), file(_file)
+            {
+            }
+            bool next(Chunk &chunk)
+            {
+                if (offset >= size)
+                    return false;
+                const std::size_t n = std::min<std::uint64_t>(blockSize, size - offset);
+                const Chunk c = { data + offset, n, offset, std::shared_ptr<std::string>() };
+                offset += n;
+                chunk = c;
+                return true;
+            }
+            void done(const Chunk &chunk) const
+            {
+                if (file != nullptr)
+                    file->release(chunk.offset, chunk.size);
+            }
+            void load(const Chunk &chunk) const
+            {
+                if (file != nullptr)
+                    file->load(chunk.offset, chunk.size);
+            }
+            std::uint64_t blocks() const
+            {
+                return (size + blockSize - 1) / blockSize;
+            }
+    };
+
+    // next block of a source, loaded and timed as input
+    template <typename Source>
+    bool nextBlock(Source &source, Chunk &chunk)
+    {
+        BW_STATS_TIMER(timer, READ, 0);
+        if (!source.next(chunk))
+            return false;
+        source.load(chunk);
+        BW_STATS_INPUT(timer, chunk.size);
+        BW_STATS_OUTPUT(timer, chunk.size);
+        return true;
+    }
+
+    // output into a caller's buffer of fixed capacity
+    class BufferSink {
+        private:
+            char *data;
+            std::size_t capacity;
+            std::size_t pos;
+        public:
+            BufferSink(void *_data, std::size_t _capacity)
+                :data(static_cast<char *>(_data)), capacity(_capacity), pos(0)
+            {
+            }
+            BufferSink &write(const char *s, std::size_t n)
+            {
+                if (n == 0)
+                    return *this;
+                if (n > capacity - pos)
+                    throw bw::OutputTooSmall();
+                std::memcpy(data + pos, s, n);
+                pos += n;
+                return *this;
+            }
+            BufferSink &flush() { return *this; }
+            std::size_t size() const { return pos; }
+    };
+
+    // output that is only counted, for testing
+    class NullSink {
+        private:
+            std::uint64_t pos;
+        public:
+            NullSink()
+                :pos(0)
+            {
+            }
+            NullSink &write(const char *, std::size_t n)
+            {
+                pos += n;
+                return *this;
+            }
+            NullSink &flush() { return *this; }
+            std::uint64_t size() const { return pos; }
+    };
+
+    // read-only stream over memory, without copying it
+    class MemoryBuffer : public std::streambuf {
+        public:
+            MemoryBuffer(const char *data, std::size_t n)
+            {
+                char *p = const_cast<char *>(data);
+                setg(p, p, p + n);
+            }
+    };
+
+    // CRC-32C of a raw block
+    std::uint32_t checksum(const char *data, std::size_t n)
+    {
+        BW_STATS_TIMER(timer, CHECKSUM, n);
+        return bw::Crc32c::compute(data, n);
+    }
+
+    // Append the entropy coded symbols of a block to out, which holds its
+    // header so far. AUTO codes them both ways and keeps the shorter one.
+    template <typename T>
+    void entropyCode(const T *in, std::size_t n, unsigned symbols, bw::Compressor::Coder coder, unsigned streams,
+            std::string &out)
+    {
+        const std::size_t start = out.size();
+        if (coder != bw::Compressor::RANS) {
+            {
+                bw::BitWriter streamout(out);
+                if (streams > 1)
+                    bw::Huffman::compressStreams(in, n, symbols, streams, streamout);
+                else
+                    bw::Huffman::compressTables(in, n, symbols, streamout);
+                streamout.flush();
+            }
+            if (streams > 1)
+                out[0] |= bw::Compressor::SPLIT_STREAMS;
+            if (coder == bw::Compressor::HUFFMAN)
+                return;
+        }
+
+        std::string rans;
+        bw::Rans::compress(in, n, symbols, rans);
+        if (coder == bw::Compressor::AUTO && out.size() - start <= rans.size())
+            return;
+        out[0] &= ~bw::Compressor::SPLIT_STREAMS;
+        out.resize(start);
+        out += rans;
+        out[0] |= bw::Compressor::RANS_CODED;
+    }
+
+    // expand the entropy coded symbols of a block from in[0..n)
+    template <typename Buffer>
+    void entropyDecode(const char *in, std::size_t n, unsigned char flags, Buffer &out, unsigned symbols)
+    {
+        if (flags & bw::Compressor::RANS_CODED) {
+            bw::Rans::expand(reinterpret_cast<const unsigned char *>(in), n, out, symbols,
+                    bw::BurrowsWheeler::MAX_BLOCK_SIZE);
+            return;
+        }
+        if (flags & bw::Compressor::SPLIT_STREAMS) {
+            bw::Huffman::expandStreams(reinterpret_cast<const unsigned char *>(in), n, out, symbols,
+                    bw::BurrowsWheeler::MAX_BLOCK_SIZE);
+            return;
+        }
+        bw::BitReader streamin(in, n);
+        bw::Huffman::expandTables(streamin, out, symbols, bw::BurrowsWheeler::MAX_BLOCK_SIZE);
+        if (streamin.overrun())
+            throw std::runtime_error("Truncated block");
+    }
+
+    // offset just past the last block of an index
+    std::uint64_t endOfBlocks(const std::vector<bw::Compressor::Block> &index)
+    {
+        if (index.empty())
+            return HEADER_SIZE;
+        return index.back().offset + 2 * sizeof(std::uint32_t) + index.back().packedSize;
+    }
+
+    // Read(buf, n, offset) fetches bytes of a compressed file of the given size.
+    // Finds the index from the trailer; false if there is none.
+    template <typename Read>
+    bool readIndexStart(Read read, std::uint64_t fileSize, std::uint64_t &indexOffset, std::uint32_t &count)
+    {
+        if (fileSize < HEADER_SIZE + TRAILER_SIZE)
+            return false;
+
+        char header[HEADER_SIZE];
+        if (!read(header, sizeof(header), 0))
+            return false;
+        bw::Compressor::checkHeader(header, sizeof(header));
+
+        char trailer[TRAILER_SIZE];
+        if (!read(trailer, sizeof(trailer), fileSize - TRAILER_SIZE)
+                || std::memcmp(trailer + sizeof(indexOffset), INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0)
+            return false;
+        std::memcpy(&indexOffset, trailer, sizeof(indexOffset));
+
+        if (indexOffset + sizeof(count) > fileSize - TRAILER_SIZE
+                || !read(&count, sizeof(count), indexOffset)
+                || indexOffset + sizeof(count) + std::uint64_t(count) * ENTRY_SIZE != fileSize - TRAILER_SIZE)
+            throw std::runtime_error("Corrupted block index");
+        return true;
+    }
+
+    // decode and check one index entry
+    bw::Compressor::Block parseEntry(const char *p, std::uint64_t indexOffset)
+    {
+        bw::Compressor::Block entry;
+        std::memcpy(&entry.offset, p, sizeof(entry.offset));
+        std::memcpy(&entry.rawOffset, p + 8, sizeof(entry.rawOffset));
+        std::memcpy(&entry.packedSize, p + 16, sizeof(entry.packedSize));
+        std::memcpy(&entry.rawSize, p + 20, sizeof(entry.rawSize));
+        if (entry.rawSize > bw::BurrowsWheeler::MAX_BLOCK_SIZE
+                || entry.offset + 2 * sizeof(std::uint32_t) + entry.packedSize > indexOffset)
+            throw std::runtime_error("Corrupted block index");
+        return entry;
+    }
+
+    template <typename Read>
+    bw::Compressor::Block readEntry(Read read, std::uint64_t indexOffset, std::uint32_t i)
+    {
+        char p[ENTRY_SIZE];
+        if (!read(p, sizeof(p), indexOffset + sizeof(std::uint32_t) + std::uint64_t(i) * ENTRY_SIZE))
+            throw std::runtime_error("Truncated block index");
+        return parseEntry(p, indexOffset);
+    }
+
+    template <typename Read>
+    bool readIndexWith(Read read, std::uint64_t fileSize, std::vector<bw::Compressor::Block> &index)
+    {
+        std::uint64_t indexOffset;
+        std::uint32_t count;
+        if (!readIndexStart(read, fileSize, indexOffset, count))
+            return false;
+
+        std::string entries(std::size_t(count) * ENTRY_SIZE, '\0');
+        if (count && !read(&entries[0], entries.size(), indexOffset + sizeof(count)))
+            throw std::runtime_error("Truncated block index");
+
+        index.resize(count);
+        std::uint64_t rawOffset = 0;
+        for (unsigned i = 0; i < count; i++) {
+            index[i] = parseEntry(entries.data() + i * ENTRY_SIZE, indexOffset);
+            if (index[i].rawOffset != rawOffset)
+                throw std::runtime_error("Corrupted block index");
+            rawOffset += index[i].rawSize;
+        }
+
+        // the end marker and the stream checksum sit between the last block and the index
+        if (endOfBlocks(index) + 2 * sizeof(std::uint32_t) != indexOffset)
+            throw std::runtime_error("Corrupted block index");
+        return true;
+    }
+
+    // The entries of the blocks overlapping raw bytes [begin, end), found by a
+    // binary search over the raw offsets, so only O(log blocks) entries are read.
+    template <typename Read>
+    bool readIndexRangeWith(Read read, std::uint64_t fileSize, std::uint64_t begin, std::uint64_t end,
+            std::vector<bw::Compressor::Block> &blocks)
+    {
+        std::uint64_t indexOffset;
+        std::uint32_t count;
+        if (!readIndexStart(read, fileSize, indexOffset, count))
+            return false;
+
+        blocks.clear();
+        if (count == 0 || begin >= end)
+            return true;
+
+        // last block starting at or before begin
+        std::uint32_t lo = 0, hi = count;
+        while (hi - lo > 1) {
+            const std::uint32_t mid = lo + (hi - lo) / 2;
+            if (readEntry(read, indexOffset, mid).rawOffset <= begin)
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+        for (std::uint32_t i = lo; i < count; i++) {
+            const bw::Compressor::Block entry = readEntry(read, indexOffset, i);
+            if (entry.rawOffset >= end)
+                break;
+            if (i == 0 ? entry.rawOffset != 0
+                    : blocks.empty() ? entry.rawOffset > begin
+                    : entry.rawOffset != blocks.back().rawOffset + blocks.back().rawSize)
+                throw std::runtime_error("Corrupted block index");
+            if (entry.rawOffset + entry.rawSize > begin)
+                blocks.push_back(entry);
+        }
+        return true;
+    }
+
+    // reads for readIndexWith() and friends from a compressed buffer
+    class MemoryRead {
+        private:
+            const char *data;
+            std::size_t size;
+        public:
+            MemoryRead(const void *_data, std::size_t _size)
+                :data(static_cast<const char *>(_data)), size(_size)
+            {
+            }
+            bool operator()(void *buf, std::size_t len, std::uint64_t offset) const
+            {
+                if (offset > size || len > size - offset)
+                    return false;
+                std::memcpy(buf, data + offset, len);
+                return true;
+            }
+    };
+
+    // passes on only the bytes at stream positions [begin, end)
+    template <typename Sink>
+    class RangeSink {
+        private:
+            Sink &sink;
+            std::uint64_t pos;
+            std::uint64_t begin, end;
+        public:
+            RangeSink(Sink &_sink, std::uint64_t _begin, std::uint64_t _end)
+                :sink(_sink), pos(0), begin(_begin), end(_end)
+            {
+            }
+            RangeSink &write(const char *s, std::size_t n)
+            {
+                const std::uint64_t lo = std::max(pos, begin), hi = std::min(pos + n, end);
+                if (lo < hi)
+                    sink.write(s + (lo - pos), hi - lo);
+                pos += n;
+                return *this;
+            }
+            RangeSink &flush()
+            {
+                sink.flush();
+                return *this;
+            }
+    };
+
+    // hand finished blocks to the writer in order until at most `keep` are still pending
+    template <typename Sink>
+    void drain(std::deque<std::future<std::string>> &window, bw::WriteBehind<Sink> &streamout, std::size_t keep)
+    {
+        for (; window.size() > keep; window.pop_front())
+            streamout.write(window.front().get());
+    }
+}
+
+const std::size_t bw::Compressor::DEFAULT_BLOCK_SIZE;
+const std::size_t bw::Compressor::HEADER_SIZE;
+const std::size_t bw::Compressor::MAX_PACKED_SIZE;
+const unsigned char bw::Compressor::ZERO_RUNS;
+const unsigned char bw::Compressor::RANS_CODED;
+const unsigned char bw::Compressor::SPLIT_STREAMS;
+const unsigned bw::Compressor::DEFAULT_STREAMS;
+
+bw::Compressor::Compressor(std::size_t _blockSize, unsigned _threads, bool _zeroRuns, Coder _coder,
+        unsigned _streams)
+    :blockSize(_blockSize)
+    ,threads(_threads ? _threads : ThreadPool::hardwareThreads())
+    ,zeroRuns(_zeroRuns)
+    ,coder(_coder)
+    ,streams(_streams)
+{
+    if (blockSize < BurrowsWheeler::MIN_BLOCK_SIZE || blockSize > BurrowsWheeler::MAX_BLOCK_SIZE)
+        throw std::invalid_argument("Block size out of range");
+    if (streams == 0 || streams > Huffman::MAX_STREAMS)
+        throw std::invalid_argument("Stream count out of range");
+}
+
+std::string bw::Compressor::header(std::size_t blockSize)
+{
+    const std::uint32_t size = blockSize;
+    std::string out(MAGIC, sizeof(MAGIC));
+    out.push_back(VERSION);
+    out.append(reinterpret_cast<const char *>(&size), sizeof(size));
+    return out;
+}
+
+void bw::Compressor::checkHeader(const char *p, std::size_t n)
+{
+    if (n < sizeof(MAGIC) || std::memcmp(p, MAGIC, sizeof(MAGIC)) != 0)
+        throw std::runtime_error("Not a compressed stream");
+    if (n < sizeof(MAGIC) + 1 || static_cast<unsigned char>(p[sizeof(MAGIC)]) != VERSION)
+        throw std::runtime_error("Unsupported stream version");
+    if (n < HEADER_SIZE)
+        throw std::runtime_error("Truncated header");
+}
+
+void bw::Compressor::compressBlock(const std::string &block, std::string &out, bool zeroRuns, Coder coder,
+        unsigned streams, std::string *fmIndex, unsigned sortThreads)
+{
+    compressBlock(block.data(), block.size(), out, zeroRuns, coder, streams, fmIndex, sortThreads);
+}
+
+void bw::Compressor::compressBlock(const char *block, std::size_t n, std::string &out, bool zeroRuns, Coder coder,
+        unsigned streams, std::string *fmIndex, unsigned sortThreads)
+{
+    if (n > BurrowsWheeler::MAX_BLOCK_SIZE)
+        throw std::invalid_argument("Block too large");
+
+    // the stages hand buffers to each other; move-to-front runs in place
+    std::string bwt;
+    std::vector<std::uint64_t> starts;
+    BW_STATS_ADD(BLOCKS, 1);
+    BW_STATS_PEAK(BLOCK_BUFFER, n);
+    {
+        // both engines give the same transform; the index samples the
+        // suffix array the transform is read from
+        const CircularSuffixArray cas(block, n,
+                sortThreads > 1 ? CircularSuffixArray::PARALLEL : CircularSuffixArray::SAIS, sortThreads);
+        BurrowsWheeler::transform(cas, block, n, bwt, starts, BurrowsWheeler::MAX_CHAINS);
+        if (fmIndex != nullptr)
+            FmIndex::build(cas, block, bwt, *fmIndex);
+    }
+    unsigned char *data = reinterpret_cast<unsigned char *>(&bwt[0]);
+    MoveToFront::encode(data, bwt.size(), data);
+
+    const unsigned char flags = zeroRuns ? ZERO_RUNS : 0;
+    const unsigned char chains = starts.size();
+    out.assign(reinterpret_cast<const char *>(&flags), sizeof(flags));
+    out.append(reinterpret_cast<const char *>(&chains), sizeof(chains));
+    // rows within a block fit 32 bits
+    for (unsigned j = 0; j < chains; j++) {
+        const std::uint32_t row = starts[j];
+        out.append(reinterpret_cast<const char *>(&row), sizeof(row));
+    }
+    const std::uint32_t crc = checksum(block, n);
+    out.append(reinterpret_cast<const char *>(&crc), sizeof(crc));
+    if (zeroRuns) {
+        std::vector<std::uint16_t> runs;
+        ZeroRunLength::encode(data, bwt.size(), runs);
+        entropyCode(runs.data(), runs.size(), ZeroRunLength::SYMBOLS, coder, streams, out);
+    }
+    else
+        entropyCode(data, bwt.size(), 256, coder, streams, out);
+    BW_STATS_PEAK(PACKED_BUFFER, out.size());
+}
+
+void bw::Compressor::expandBlock(const std::string &in, std::string &out)
+{
+    expandBlock(in.data(), in.size(), out);
+}
+
+void bw::Compressor::expandBlock(const char *in, std::size_t n, std::string &out)
+{
+    BW_STATS_ADD(BLOCKS, 1);
+    BW_STATS_PEAK(PACKED_BUFFER, n);
+    unsigned char flags, chains;
+    if (n < sizeof(flags) + sizeof(chains))
+        throw std::runtime_error("Truncated block");
+    std::memcpy(&flags, in, sizeof(flags));
+    std::memcpy(&chains, in + sizeof(flags), sizeof(chains));
+    if (flags & ~(ZERO_RUNS | RANS_CODED | SPLIT_STREAMS) || (flags & RANS_CODED && flags & SPLIT_STREAMS))
+        throw std::runtime_error("Unsupported block flags");
+
+    std::vector<std::uint64_t> starts(chains);
+    std::size_t at = sizeof(flags) + sizeof(chains);
+    if (chains > BurrowsWheeler::MAX_CHAINS || n < at + chains * sizeof(std::uint32_t))
+        throw std::runtime_error("Corrupted block");
+    for (unsigned j = 0; j < chains; j++, at += sizeof(std::uint32_t)) {
+        std::uint32_t row;
+        std::memcpy(&row, in + at, sizeof(row));
+        starts[j] = row;
+    }
+    std::uint32_t crc;
+    if (n < at + sizeof(crc))
+        throw std::runtime_error("Truncated block");
+    std::memcpy(&crc, in + at, sizeof(crc));
+    at += sizeof(crc);
+
+    std::string mtf;
+    if (flags & ZERO_RUNS) {
+        std::vector<std::uint16_t> runs;
+        entropyDecode(in + at, n - at, flags, runs, ZeroRunLength::SYMBOLS);
+        ZeroRunLength::decode(runs.data(), runs.size(), mtf, BurrowsWheeler::MAX_BLOCK_SIZE);
+    }
+    else
+        entropyDecode(in + at, n - at, flags, mtf, 256);
+    unsigned char *data = reinterpret_cast<unsigned char *>(&mtf[0]);
+    MoveToFront::decode(data, mtf.size(), data);
+    BurrowsWheeler::inverse(starts, mtf, out);
+    BW_STATS_PEAK(BLOCK_BUFFER, out.size());
+    if (checksum(out.data(), out.size()) != crc)
+        throw std::runtime_error("Block checksum mismatch");
+}
+
+std::uint32_t bw::Compressor::blockChecksum(const char *in, std::size_t n)
+{
+    unsigned char chains;
+    const std::size_t at = 2 * sizeof(chains);
+    if (n < at)
+        throw std::runtime_error("Truncated block");
+    std::memcpy(&chains, in + sizeof(unsigned char), sizeof(chains));
+    std::uint32_t crc;
+    if (n < at + chains * sizeof(std::uint32_t) + sizeof(crc))
+        throw std::runtime_error("Truncated block");
+    std::memcpy(&crc, in + at + chains * sizeof(std::uint32_t), sizeof(crc));
+    return crc;
+}
+
+void bw::Compressor::compress(std::istream &streamin, std::ostream &streamout) const
+{
+    StreamSource source(streamin, blockSize);
+    compressFrom(source, streamout);
+}
+
+void bw::Compressor::compress(const std::string &inPath, const std::string &outPath,
+        const std::string &indexPath) const
+{
+    std::unique_ptr<FileWriter> file(outPath.empty() ? new FileWriter(STDOUT_FILENO) : new FileWriter(outPath));
+    std::unique_ptr<FileWriter> index(indexPath.empty() ? nullptr : new FileWriter(indexPath));
+    if (inPath.empty()) {
+        StreamSource source(std::cin, blockSize);
+        compressFrom(source, *file, index.get());
+    }
+    else {
+        const MappedFile input(inPath);
+        if (input.mapped()) {
+            MemorySource source(input.data(), input.size(), blockSize, &input);
+            compressFrom(source, *file, index.get());
+        }
+        else {
+            std::ifstream streamin(inPath.c_str(), std::ios::binary | std::ios::in);
+            StreamSource source(streamin, blockSize);
+            compressFrom(source, *file, index.get());
+        }
+    }
+    file->flush();
+    if (index)
+        index->flush();
+}
+
+// Blocks are read ahead on one thread, packed on the pool and written behind
+// on another, so reading, compressing and writing all overlap.
+template <typename Source, typename Sink>
+void bw::Compressor::compressFrom(Source &source, Sink &streamout, FileWriter *fmIndex) const
+{
+    const std::string head = header(blockSize);
+    streamout.write(head.data(), head.size());
+    if (fmIndex != nullptr) {
+        const std::string fmHead = FmIndex::header();
+        fmIndex->write(fmHead.data(), fmHead.size());
+    }
+
+    // keep a bounded window of blocks in flight, written back in input order,
+    // each packed along with its FM-index section when one is wanted
+    typedef std::pair<std::string, std::string> Packed;
+    typedef std::pair<Chunk, std::future<Packed>> Pending;
+    ThreadPool pool(threads);
+    WriteBehind<Sink> writer(streamout, WRITE_BEHIND);
+    std::unique_ptr<WriteBehind<FileWriter>> fmWriter(
+            fmIndex != nullptr ? new WriteBehind<FileWriter>(*fmIndex, WRITE_BEHIND) : nullptr);
+    std::deque<Pending> window;
+    const std::size_t maxInFlight = 2 * pool.size();
+    // cores left idle by too few blocks sort within them instead, so that
+    // the pool and the sorters together never outnumber the cores
+    const std::uint64_t blocks = source.blocks();
+    const unsigned cores = std::min(pool.size(), ThreadPool::hardwareThreads());
+    const unsigned sortThreads = blocks != 0 && blocks < cores ? unsigned(cores / blocks) : 1;
+
+    std::vector<Block> index;
+    std::uint64_t offset = HEADER_SIZE;
+    std::uint32_t crc = 0;
+    auto flushFront = [&] {
+        Packed both = window.front().second.get();
+        const std::string &packed = both.first;
+        const Block entry = { offset, window.front().first.offset,
+            std::uint32_t(packed.size()), std::uint32_t(window.front().first.size) };
+        crc = Crc32c::combine(crc, blockChecksum(packed.data(), packed.size()), entry.rawSize);
+        index.push_back(entry);
+        offset += 2 * sizeof(std::uint32_t) + packed.size();
+        writeBlock(writer, entry.rawSize, std::move(both.first));
+        if (fmWriter) {
+            put(*fmWriter, entry.rawOffset);
+            fmWriter->write(std::move(both.second));
+        }
+        source.done(window.front().first);
+        window.pop_front();
+    };
+
+    ReadAhead<Chunk> reader([&source](Chunk &c) { return nextBlock(source, c); }, READ_AHEAD);
+    Chunk chunk;
+    while (reader.next(chunk))
+    {
+        const bool runs = zeroRuns;
+        const Coder blockCoder = coder;
+        const unsigned blockStreams = streams;
+        const bool indexed = fmIndex != nullptr;
+        window.emplace_back(chunk, pool.submit([chunk, runs, blockCoder, blockStreams, indexed, sortThreads] {
+            Packed both;
+            compressBlock(chunk.data, chunk.size, both.first, runs, blockCoder, blockStreams,
+                    indexed ? &both.second : nullptr, sortThreads);
+            return both;
+        }));
+        BW_STATS_PEAK(IN_FLIGHT, window.size());
+
+        if (window.size() >= maxInFlight)
+            flushFront();
+    }
+    while (!window.empty())
+        flushFront();
+    writer.finish();
+    if (fmWriter)
+        fmWriter->finish();
+
+    put(streamout, 0u);
+    put(streamout, crc);
+    offset += 2 * sizeof(std::uint32_t);
+
+    // 2^32 blocks of at least MIN_BLOCK_SIZE are hundreds of terabytes
+    if (index.size() > UINT32_MAX)
+        throw std::length_error("Too many blocks for the index");
+    const std::uint32_t count = index.size();
+    put(streamout, count);
+    for (unsigned i = 0; i < index.size(); i++) {
+        put(streamout, index[i].offset);
+        put(streamout, index[i].rawOffset);
+        put(streamout, index[i].packedSize);
+        put(streamout, index[i].rawSize);
+    }
+    put(streamout, offset);
+    streamout.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    streamout.flush();
+    if (fmIndex != nullptr) {
+        const std::string fmTail = FmIndex::trailer(index.size());
+        fmIndex->write(fmTail.data(), fmTail.size());
+    }
+}
+
+void bw::Compressor::expand(std::istream &streamin, std::ostream &streamout) const
+{
+    expandFrom(streamin, streamout);
+}
+
+void bw::Compressor::expand(const std::string &path, std::ostream &streamout) const
+{
+    expandPath(path, streamout);
+}
+
+void bw::Compressor::expand(const std::string &inPath, const std::string &outPath) const
+{
+    std::unique_ptr<FileWriter> file(outPath.empty() ? new FileWriter(STDOUT_FILENO) : new FileWriter(outPath));
+    if (inPath.empty())
+        expandFrom(std::cin, *file);
+    else
+        expandPath(inPath, *file);
+    file->flush();
+}
+
+void bw::Compressor::test(const std::string &inPath) const
+{
+    NullSink sink;
+    if (inPath.empty())
+        expandFrom(std::cin, sink);
+    else
+        expandPath(inPath, sink);
+}
+
+template <typename Sink>
+void bw::Compressor::expandFrom(std::istream &streamin, Sink &streamout) const
+{
+    readHeader(streamin);
+
+    ThreadPool pool(threads);
+    std::deque<std::future<std::string>> window;
+    const std::size_t maxInFlight = 2 * pool.size();
+    WriteBehind<Sink> writer(streamout, WRITE_BEHIND);
+
+    // packed blocks with their raw size, read on a thread of their own up
+    // to the end marker
+    typedef std::pair<unsigned, std::shared_ptr<std::string>> Packed;
+    ReadAhead<Packed> reader([&streamin](Packed &block) {
+        unsigned rawSize, packedSize;
+        if (!get(streamin, rawSize) || rawSize == 0)
+            return false;
+        if (rawSize > BurrowsWheeler::MAX_BLOCK_SIZE || !get(streamin, packedSize) || packedSize > MAX_PACKED_SIZE)
+            throw std::runtime_error("Corrupted block header");
+        std::shared_ptr<std::string> packed(new std::string(packedSize, '\0'));
+        BW_STATS_TIMER(timer, READ, packedSize);
+        BW_STATS_OUTPUT(timer, packedSize);
+        if (!streamin.read(&(*packed)[0], packedSize))
+            throw std::runtime_error("Truncated block");
+        block = Packed(rawSize, packed);
+        return true;
+    }, READ_AHEAD);
+
+    Packed block;
+    std::uint32_t crc = 0;
+    while (reader.next(block))
+    {
+        const unsigned rawSize = block.first;
+        const std::shared_ptr<std::string> packed = block.second;
+        crc = Crc32c::combine(crc, blockChecksum(packed->data(), packed->size()), rawSize);
+
+        window.push_back(pool.submit([packed, rawSize] {
+            std::string block;
+            expandBlock(*packed, block);
+            if (block.size() != rawSize)
+                throw std::runtime_error("Corrupted block");
+            return block;
+        }));
+        BW_STATS_PEAK(IN_FLIGHT, window.size());
+        drain(window, writer, maxInFlight - 1);
+    }
+    // the end marker is followed by the checksum of the whole stream
+    std::uint32_t expected;
+    if (!streamin || !get(streamin, expected))
+        throw std::runtime_error("Truncated stream");
+    drain(window, writer, 0);
+    writer.finish();
+    streamout.flush();
+    if (crc != expected)
+        throw std::runtime_error("Stream checksum mismatch");
+}
+
+// a mapped file with an index is expanded in place, each worker reading its own blocks
+template <typename Sink>
+void bw::Compressor::expandPath(const std::string &path, Sink &streamout) const
+{
+    std::vector<Block> index;
+    const MappedFile input(path);
+    if (!input.mapped() || !readIndex(input.descriptor(), index)) {
+        std::ifstream streamin(path.c_str(), std::ios::binary | std::ios::in);
+        expandFrom(streamin, streamout);
+        return;
+    }
+
+    expandIndexed(input.data(), index, streamout, &input);
+}
+
+// the whole indexed stream, checked against the stream checksum
+template <typename Sink>
+void bw::Compressor::expandIndexed(const char *data, const std::vector<Block> &index, Sink &streamout,
+        const MappedFile *file) const
+{
+    const std::uint32_t crc = expandBlocks(data, index, 0, UINT64_MAX, streamout, file);
+
+    std::uint32_t end, expected;
+    std::memcpy(&end, data + endOfBlocks(index), sizeof(end));
+    std::memcpy(&expected, data + endOfBlocks(index) + sizeof(end), sizeof(expected));
+    if (end != 0)
+        throw std::runtime_error("Corrupted end marker");
+    if (crc != expected)
+        throw std::runtime_error("Stream checksum mismatch");
+}
+
+// Each worker expands its own blocks in place and keeps their raw bytes in
+// [begin, end); pages of a mapped file are dropped once read. Returns the
+// checksum of the blocks as recorded in them.
+template <typename Sink>
+std::uint32_t bw::Compressor::expandBlocks(const char *data, const std::vector<Block> &blocks,
+        std::uint64_t begin, std::uint64_t end, Sink &streamout, const MappedFile *file) const
+{
+    ThreadPool pool(threads);
+    std::deque<std::future<std::string>> window;
+    const std::size_t maxInFlight = 2 * pool.size();
+    WriteBehind<Sink> writer(streamout, WRITE_BEHIND);
+
+    // the pages of a mapped file are faulted in ahead of the workers
+    std::size_t loaded = 0;
+    ReadAhead<std::size_t> reader([&](std::size_t &i) {
+        if (loaded == blocks.size())
+            return false;
+        i = loaded++;
+        if (file != nullptr) {
+            BW_STATS_TIMER(timer, READ, blocks[i].packedSize);
+            file->load(blocks[i].offset, 2 * sizeof(std::uint32_t) + blocks[i].packedSize);
+        }
+        return true;
+    }, READ_AHEAD);
+
+    std::uint32_t crc = 0;
+    for (std::size_t i; reader.next(i); )
+    {
+        const Block entry = blocks[i];
+        const std::uint64_t at = entry.offset + 2 * sizeof(std::uint32_t);
+        crc = Crc32c::combine(crc, blockChecksum(data + at, entry.packedSize), entry.rawSize);
+        const std::size_t lo = std::max(begin, entry.rawOffset) - entry.rawOffset;
+        const std::size_t hi = std::min(end, entry.rawOffset + entry.rawSize) - entry.rawOffset;
+        window.push_back(pool.submit([data, file, at, entry, lo, hi] {
+            std::string block;
+            expandBlock(data + at, entry.packedSize, block);
+            if (file != nullptr)
+                file->release(at, entry.packedSize);
+            if (block.size() != entry.rawSize)
+                throw std::runtime_error("Corrupted block");
+            if (lo != 0 || hi != block.size()) {
+                block.resize(hi);
+                block.erase(0, lo);
+            }
+            return block;
+        }));
+        BW_STATS_PEAK(IN_FLIGHT, window.size());
+        drain(window, writer, maxInFlight - 1);
+    }
+    drain(window, writer, 0);
+    writer.finish();
+    streamout.flush();
+    return crc;
+}
+
+void bw::Compressor::expandRange(const std::string &inPath, const std::string &outPath,
+        std::uint64_t offset, std::uint64_t length) const
+{
+    const std::uint64_t end = offset + std::min(length, UINT64_MAX - offset);
+    std::unique_ptr<FileWriter> file(outPath.empty() ? new FileWriter(STDOUT_FILENO) : new FileWriter(outPath));
+    std::unique_ptr<MappedFile> input(inPath.empty() ? nullptr : new MappedFile(inPath));
+    std::vector<Block> blocks;
+    if (input && input->mapped() && readIndexRange(input->data(), input->size(), offset, length, blocks))
+        expandBlocks(input->data(), blocks, offset, end, *file, input.get());
+    else {
+        // no index: expand everything, keeping the range
+        RangeSink<FileWriter> sink(*file, offset, end);
+        if (inPath.empty())
+            expandFrom(std::cin, sink);
+        else {
+            std::ifstream streamin(inPath.c_str(), std::ios::binary | std::ios::in);
+            expandFrom(streamin, sink);
+        }
+    }
+    file->flush();
+}
+
+std::size_t bw::Compressor::expandRange(const void *in, std::size_t n, std::uint64_t offset, std::uint64_t length,
+        void *out, std::size_t capacity) const
+{
+    const std::uint64_t end = offset + std::min(length, UINT64_MAX - offset);
+    BufferSink sink(out, capacity);
+    std::vector<Block> blocks;
+    if (readIndexRange(in, n, offset, length, blocks))
+        expandBlocks(static_cast<const char *>(in), blocks, offset, end, sink, nullptr);
+    else {
+        RangeSink<BufferSink> range(sink, offset, end);
+        MemoryBuffer buffer(static_cast<const char *>(in), n);
+        std::istream streamin(&buffer);
+        expandFrom(streamin, range);
+    }
+    return sink.size();
+}
+
+std::size_t bw::Compressor::compress(const void *in, std::size_t n, void *out, std::size_t capacity) const
+{
+    MemorySource source(static_cast<const char *>(in), n, blockSize);
+    BufferSink sink(out, capacity);
+    compressFrom(source, sink);
+    return sink.size();
+}
+
+std::size_t bw::Compressor::expand(const void *in, std::size_t n, void *out, std::size_t capacity) const
+{
+    BufferSink sink(out, capacity);
+    std::vector<Block> index;
+    if (readIndex(in, n, index))
+        expandIndexed(static_cast<const char *>(in), index, sink, nullptr);
+    else {
+        MemoryBuffer buffer(static_cast<const char *>(in), n);
+        std::istream streamin(&buffer);
+        expandFrom(streamin, sink);
+    }
+    return sink.size();
+}
+
+std::size_t bw::Compressor::compressBound(std::size_t n, std::size_t blockSize)
+{
+    // header, per block its sizes, packed bytes and index entry, end marker,
+    // stream checksum, index count and trailer
+    const std::size_t blocks = (n + blockSize - 1) / blockSize;
+    return HEADER_SIZE + 2 * n + blocks * (2 * sizeof(std::uint32_t) + (64 << 10) + ENTRY_SIZE)
+        + 3 * sizeof(std::uint32_t) + TRAILER_SIZE;
+}
+
+bool bw::Compressor::expandedSize(const void *in, std::size_t n, std::uint64_t &size)
+{
+    // the raw end of the last block
+    const MemoryRead read(in, n);
+    std::uint64_t indexOffset;
+    std::uint32_t count;
+    if (!readIndexStart(read, n, indexOffset, count))
+        return false;
+    size = 0;
+    if (count) {
+        const Block last = readEntry(read, indexOffset, count - 1);
+        size = last.rawOffset + last.rawSize;
+    }
+    return true;
+}
+
+bool bw::Compressor::readIndexRange(const void *data, std::size_t n, std::uint64_t offset, std::uint64_t length,
+        std::vector<Block> &blocks)
+{
+    const std::uint64_t end = offset + std::min(length, UINT64_MAX - offset);
+    return readIndexRangeWith(MemoryRead(data, n), n, offset, end, blocks);
+}
+
+bool bw::Compressor::readIndex(const void *data, std::size_t n, std::vector<Block> &index)
+{
+    return readIndexWith(MemoryRead(data, n), n, index);
+}
+
+bool bw::Compressor::readIndex(int fd, std::vector<Block> &index)
+{
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    return readIndexWith([fd](void *buf, std::size_t len, std::uint64_t offset) {
+        return preadFully(fd, buf, len, offset);
+    }, st.st_size, index);
+}
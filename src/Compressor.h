@@ -0,0 +1,171 @@
+#ifndef _COMPRESSOR_H_
+#define _COMPRESSOR_H_
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+#include <cstdint>
+
+namespace bw
+{
+    class MappedFile;
+    class FileWriter;
+
+    // the output of a buffer-to-buffer call does not fit in its capacity;
+    // other length errors mean the input itself is too large
+    class OutputTooSmall : public std::length_error {
+        public:
+            OutputTooSmall()
+                :std::length_error("Output buffer too small")
+            {
+            }
+    };
+
+    // Block compressor chaining Burrows-Wheeler, move-to-front and Huffman.
+    // Blocks are compressed independently on a pool of threads and written
+    // in their original order.
+    //
+    // Container layout (integers in host byte order, as in the stage tools):
+    //   header  "BWC" version:8  block_size:32
+    //   block   raw_size:32 packed_size:32 packed[packed_size]
+    //   ...
+    //   end     raw_size:32 = 0  crc:32
+    //   index   count:32, then per block offset:64 raw_offset:64 packed_size:32 raw_size:32
+    //   trailer index_offset:64 "BWCI"
+    // A packed block is a flags byte, the number of inverse BWT chains:8 and
+    // their start rows (32 bits each, the first being the BWT first row), the
+    // CRC-32C of the raw block:32, followed by the multi-table Huffman stream
+    // of the move-to-front encoded transform, split into several bitstreams
+    // with the SPLIT_STREAMS flag, or its rANS stream with the RANS_CODED
+    // flag; with the ZERO_RUNS flag its zero runs are RUNA/RUNB coded before
+    // the entropy coder. The crc after the end marker is
+    // the CRC-32C of the whole raw stream. Block offsets are those of the
+    // block's raw_size field from the start of the stream; raw offsets are
+    // those of the block's first byte in the raw data, so a range of raw
+    // bytes maps to its blocks by a binary search of the index.
+    class Compressor {
+        public:
+            static const std::size_t DEFAULT_BLOCK_SIZE = 900 << 10;
+            static const std::size_t HEADER_SIZE = 8;
+            // bound on packed_size: under two bytes per symbol of the largest
+            // block (BurrowsWheeler::MAX_BLOCK_SIZE), plus the block's tables
+            static const std::size_t MAX_PACKED_SIZE = 2 * (64 << 20) + (64 << 10);
+
+            // flags of a packed block
+            static const unsigned char ZERO_RUNS = 1;
+            static const unsigned char RANS_CODED = 2;
+            static const unsigned char SPLIT_STREAMS = 4;
+
+            // Huffman bitstreams per block; 1 writes a single stream
+            static const unsigned DEFAULT_STREAMS = 4;
+
+            // entropy coder of the blocks
+            enum Coder {
+                HUFFMAN,    // multi-table Huffman
+                RANS,       // interleaved rANS
+                AUTO        // both, keeping the shorter per block
+            };
+
+            // entry of the block index
+            struct Block {
+                std::uint64_t offset;
+                std::uint64_t rawOffset;
+                std::uint32_t packedSize;
+                std::uint32_t rawSize;
+            };
+
+        private:
+            std::size_t blockSize;
+            unsigned threads;
+            bool zeroRuns;
+            Coder coder;
+            unsigned streams;
+
+        public:
+            // threads = 0 uses every hardware thread
+            Compressor(std::size_t _blockSize = DEFAULT_BLOCK_SIZE, unsigned _threads = 0, bool _zeroRuns = true,
+                    Coder _coder = HUFFMAN, unsigned _streams = DEFAULT_STREAMS);
+
+            void compress(std::istream &streamin, std::ostream &streamout) const;
+            void expand(std::istream &streamin, std::ostream &streamout) const;
+            // expand a file through its block index, each worker reading its own blocks
+            void expand(const std::string &path, std::ostream &streamout) const;
+
+            // File to file: the input is memory mapped when it is a regular file
+            // and the output goes straight to the descriptor in large writes. An
+            // empty path stands for standard input or output. With an index
+            // path an FmIndex of the blocks is written there as well, built
+            // from the same suffix sorts; the compressed stream is unchanged.
+            void compress(const std::string &inPath, const std::string &outPath,
+                    const std::string &indexPath = std::string()) const;
+            void expand(const std::string &inPath, const std::string &outPath) const;
+            // expand without writing anything, checking every block and the
+            // stream checksum; throws on damage
+            void test(const std::string &inPath) const;
+
+            // Expand only raw bytes [offset, offset + length), clipped to the
+            // data. With a block index only the overlapping blocks are read and
+            // decoded, whatever the size of the input; without one the whole
+            // stream is expanded and trimmed. Block checksums are checked, the
+            // stream checksum only by a full expand or test().
+            void expandRange(const std::string &inPath, const std::string &outPath,
+                    std::uint64_t offset, std::uint64_t length) const;
+            std::size_t expandRange(const void *in, std::size_t n, std::uint64_t offset, std::uint64_t length,
+                    void *out, std::size_t capacity) const;
+
+            // Buffer to buffer: returns the number of bytes written to out and
+            // throws OutputTooSmall if they do not fit in capacity.
+            std::size_t compress(const void *in, std::size_t n, void *out, std::size_t capacity) const;
+            std::size_t expand(const void *in, std::size_t n, void *out, std::size_t capacity) const;
+            // capacity that always holds the compressed form of n bytes
+            std::size_t static compressBound(std::size_t n, std::size_t blockSize = DEFAULT_BLOCK_SIZE);
+            // expanded size recorded in the index of a compressed buffer; false if it has none
+            bool static expandedSize(const void *in, std::size_t n, std::uint64_t &size);
+
+            // stream header for the given block size
+            std::string static header(std::size_t blockSize);
+            // throws unless p[0..n) starts with a supported header of HEADER_SIZE bytes
+            void static checkHeader(const char *p, std::size_t n);
+
+            // read the block index of a compressed file; false if it has none
+            bool static readIndex(int fd, std::vector<Block> &index);
+            bool static readIndex(const void *data, std::size_t n, std::vector<Block> &index);
+            // the index entries of the blocks overlapping raw bytes [offset, offset + length)
+            bool static readIndexRange(const void *data, std::size_t n, std::uint64_t offset, std::uint64_t length,
+                    std::vector<Block> &blocks);
+
+            // with fmIndex, also append the block's FmIndex section to it; with
+            // more than one sortThreads the block is suffix sorted on that many
+            // (CircularSuffixArray::PARALLEL), for the same output
+            void static compressBlock(const std::string &block, std::string &out, bool zeroRuns = true,
+                    Coder coder = HUFFMAN, unsigned streams = DEFAULT_STREAMS, std::string *fmIndex = nullptr,
+                    unsigned sortThreads = 1);
+            void static compressBlock(const char *block, std::size_t n, std::string &out, bool zeroRuns = true,
+                    Coder coder = HUFFMAN, unsigned streams = DEFAULT_STREAMS, std::string *fmIndex = nullptr,
+                    unsigned sortThreads = 1);
+            void static expandBlock(const std::string &in, std::string &out);
+            void static expandBlock(const char *in, std::size_t n, std::string &out);
+            // CRC-32C of the raw data of a packed block, as recorded in it
+            std::uint32_t static blockChecksum(const char *in, std::size_t n);
+
+        private:
+            // Source yields blocks through next() and is told when each is written;
+            // Sink is a std::ostream or a FileWriter; the FM-index, if any,
+            // goes to fmIndex
+            template <typename Source, typename Sink>
+            void compressFrom(Source &source, Sink &streamout, FileWriter *fmIndex = nullptr) const;
+            template <typename Sink>
+            void expandFrom(std::istream &streamin, Sink &streamout) const;
+            template <typename Sink>
+            void expandPath(const std::string &path, Sink &streamout) const;
+            template <typename Sink>
+            void expandIndexed(const char *data, const std::vector<Block> &index, Sink &streamout,
+                    const MappedFile *file) const;
+            template <typename Sink>
+            std::uint32_t expandBlocks(const char *data, const std::vector<Block> &blocks,
+                    std::uint64_t begin, std::uint64_t end, Sink &streamout, const MappedFile *file) const;
+    };
+}
+
+#endif
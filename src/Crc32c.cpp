@@ -0,0 +1,137 @@
+#include "Crc32c.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define BW_CRC32C_SSE42 1
+#endif
+
+namespace
+{
+    // reflected polynomial
+    const std::uint32_t POLY = 0x82f63b78;
+
+    // tables[k][b]: checksum of byte b followed by k zero bytes
+    struct Tables {
+        std::uint32_t t[8][256];
+
+        Tables()
+        {
+            for (unsigned b = 0; b < 256; b++) {
+                std::uint32_t c = b;
+                for (int k = 0; k < 8; k++)
+                    c = c & 1 ? (c >> 1) ^ POLY : c >> 1;
+                t[0][b] = c;
+            }
+            for (unsigned b = 0; b < 256; b++)
+                for (int k = 1; k < 8; k++)
+                    t[k][b] = (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xff];
+        }
+    };
+
+    const Tables &tables()
+    {
+        static const Tables tables;
+        return tables;
+    }
+
+    // slicing-by-8 on the raw (pre-inverted) register
+    std::uint32_t updateTables(std::uint32_t c, const unsigned char *p, std::size_t n)
+    {
+        const std::uint32_t (*t)[256] = tables().t;
+        for (; n >= 8; n -= 8, p += 8) {
+            std::uint32_t lo, hi;
+            std::memcpy(&lo, p, sizeof(lo));
+            std::memcpy(&hi, p + 4, sizeof(hi));
+            lo ^= c;
+            c = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+              ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+        }
+        for (; n; n--, p++)
+            c = (c >> 8) ^ t[0][(c ^ *p) & 0xff];
+        return c;
+    }
+
+#if BW_CRC32C_SSE42
+    __attribute__((target("sse4.2")))
+    std::uint32_t updateHardware(std::uint32_t c, const unsigned char *p, std::size_t n)
+    {
+        std::uint64_t c64 = c;
+        for (; n >= 8; n -= 8, p += 8) {
+            std::uint64_t v;
+            std::memcpy(&v, p, sizeof(v));
+            c64 = _mm_crc32_u64(c64, v);
+        }
+        c = c64;
+        for (; n; n--, p++)
+            c = _mm_crc32_u8(c, *p);
+        return c;
+    }
+#endif
+
+    typedef std::uint32_t (*Update)(std::uint32_t, const unsigned char *, std::size_t);
+
+    Update pick()
+    {
+#if BW_CRC32C_SSE42
+        if (__builtin_cpu_supports("sse4.2"))
+            return updateHardware;
+#endif
+        return updateTables;
+    }
+
+    Update dispatch()
+    {
+        static const Update update = pick();
+        return update;
+    }
+
+    // a * b modulo the polynomial, bit 31 standing for x^0
+    std::uint32_t multiply(std::uint32_t a, std::uint32_t b)
+    {
+        std::uint32_t m = 1u << 31, p = 0;
+        for (;;) {
+            if (a & m) {
+                p ^= b;
+                if ((a & (m - 1)) == 0)
+                    break;
+            }
+            m >>= 1;
+            b = b & 1 ? (b >> 1) ^ POLY : b >> 1;
+        }
+        return p;
+    }
+
+    // x^(8n) modulo the polynomial, by squaring
+    std::uint32_t shiftBytes(std::uint64_t n)
+    {
+        std::uint32_t p = 1u << 31;     // 1
+        std::uint32_t x = 1u << 23;     // x^8
+        for (; n; n >>= 1) {
+            if (n & 1)
+                p = multiply(x, p);
+            x = multiply(x, x);
+        }
+        return p;
+    }
+}
+
+std::uint32_t bw::Crc32c::update(std::uint32_t crc, const void *data, std::size_t n)
+{
+    return ~dispatch()(~crc, static_cast<const unsigned char *>(data), n);
+}
+
+std::uint32_t bw::Crc32c::combine(std::uint32_t crcA, std::uint32_t crcB, std::uint64_t lengthB)
+{
+    return multiply(shiftBytes(lengthB), crcA) ^ crcB;
+}
+
+bool bw::Crc32c::hardware()
+{
+#if BW_CRC32C_SSE42
+    return dispatch() == updateHardware;
+#else
+    return false;
+#endif
+}
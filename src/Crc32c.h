@@ -0,0 +1,38 @@
+#ifndef _CRC32C_H_
+#define _CRC32C_H_
+
+#include <cstdint>
+#include <cstddef>
+
+namespace bw
+{
+    // CRC-32C (Castagnoli, as in iSCSI and ext4). Uses the SSE4.2 crc32
+    // instruction when the processor has it, checked once at run time, and
+    // slicing-by-8 tables otherwise. Checksums of adjacent pieces combine
+    // without the data, so blocks checksummed on separate threads add up to
+    // the checksum of the whole stream.
+    class Crc32c {
+        private:
+            // Do not instantiate.
+            Crc32c()
+            {
+            }
+
+        public:
+            // checksum of data[0..n) following data whose checksum is crc (0 to start)
+            std::uint32_t static update(std::uint32_t crc, const void *data, std::size_t n);
+
+            std::uint32_t static compute(const void *data, std::size_t n)
+            {
+                return update(0, data, n);
+            }
+
+            // checksum of A followed by B, from those of A and B and B's length
+            std::uint32_t static combine(std::uint32_t crcA, std::uint32_t crcB, std::uint64_t lengthB);
+
+            // whether update() runs on the crc32 instruction
+            bool static hardware();
+    };
+}
+
+#endif
@@ -0,0 +1,70 @@
+#include "FileWriter.h"
+
+#include <stdexcept>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+const std::size_t bw::FileWriter::BUFFER_SIZE;
+
+bw::FileWriter::FileWriter(int _fd)
+    :buffer(BUFFER_SIZE), pos(0), fd(_fd), owned(false)
+{
+}
+
+bw::FileWriter::FileWriter(const std::string &path)
+    :buffer(BUFFER_SIZE), pos(0), fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666)), owned(true)
+{
+    if (fd < 0)
+        throw std::runtime_error("Cannot open " + path);
+}
+
+bw::FileWriter::~FileWriter()
+{
+    try {
+        flush();
+    }
+    catch (...) {
+    }
+    if (owned)
+        ::close(fd);
+}
+
+bw::FileWriter &bw::FileWriter::flush()
+{
+    return writeLarge(nullptr, 0);
+}
+
+// hand the buffer and then s[0..n) to the descriptor
+bw::FileWriter &bw::FileWriter::writeLarge(const char *s, std::size_t n)
+{
+    struct iovec iov[2];
+    iov[0].iov_base = &buffer[0];
+    iov[0].iov_len = pos;
+    iov[1].iov_base = const_cast<char *>(s);
+    iov[1].iov_len = n;
+
+    struct iovec *v = iov;
+    int count = n ? 2 : 1;
+    pos = 0;
+    while (count > 0 && (v[0].iov_len > 0 || count > 1)) {
+        const ssize_t w = ::writev(fd, v, count);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("Write error");
+        }
+        std::size_t done = w;
+        while (count > 0 && done >= v[0].iov_len) {
+            done -= v[0].iov_len;
+            v++;
+            count--;
+        }
+        if (count > 0) {
+            v[0].iov_base = static_cast<char *>(v[0].iov_base) + done;
+            v[0].iov_len -= done;
+        }
+    }
+    return *this;
+}
@@ -0,0 +1,54 @@
+#ifndef _FILEWRITER_H_
+#define _FILEWRITER_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+namespace bw
+{
+    // Buffered output straight to a file descriptor. Small writes are
+    // gathered in one large preallocated buffer; large ones go to the
+    // descriptor together with what is buffered, in a single writev().
+    // Has the write()/flush() shape of std::ostream so stream code can be
+    // shared.
+    class FileWriter {
+        public:
+            static const std::size_t BUFFER_SIZE = 1 << 20;
+
+        private:
+            std::vector<char> buffer;
+            std::size_t pos;
+            int fd;
+            bool owned;
+
+        public:
+            FileWriter(const FileWriter &that)=delete;
+            FileWriter &operator=(const FileWriter &that)=delete;
+
+            // write to an open descriptor, which is left open
+            explicit FileWriter(int _fd);
+            // create or truncate path; throws if it cannot be opened
+            explicit FileWriter(const std::string &path);
+            // flushes what is left; call flush() first to see errors
+            ~FileWriter();
+
+            FileWriter &write(const char *s, std::size_t n)
+            {
+                if (n <= BUFFER_SIZE - pos) {
+                    std::memcpy(&buffer[pos], s, n);
+                    pos += n;
+                    return *this;
+                }
+                return writeLarge(s, n);
+            }
+
+            FileWriter &flush();
+
+        private:
+            FileWriter &writeLarge(const char *s, std::size_t n);
+    };
+}
+
+#endif
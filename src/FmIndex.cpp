@@ -0,0 +1,517 @@
+#include "FmIndex.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+#include "CircularSuffixArray.h"
+#include "MappedFile.h"
+#include "Stats.h"
+
+const unsigned bw::FmIndex::SAMPLE_RATE;
+const std::size_t bw::FmIndex::HEADER_SIZE;
+const std::size_t bw::FmIndex::TRAILER_SIZE;
+const unsigned bw::FmIndex::LEVELS;
+
+namespace
+{
+    const char MAGIC[] = { 'B', 'W', 'F', 'I' };
+    const char END_MAGIC[] = { 'B', 'W', 'F', 'I', 'E', 'N', 'D', '\0' };
+    const unsigned char VERSION = 2;
+    static_assert(bw::FmIndex::HEADER_SIZE == sizeof(MAGIC) + 4, "header layout");
+    static_assert(bw::FmIndex::TRAILER_SIZE == sizeof(std::uint64_t) + sizeof(END_MAGIC), "trailer layout");
+
+    // A line of a bit-vector is a word of counts then LINE_BITS bits, 64
+    // bytes in all: the high 32 bits count the ones before the line, and
+    // bits [10 * j - 10, 10 * j) those in the line before its word 2 * j,
+    // for j = 1, 2, 3.
+    const unsigned LINE_BITS = 448;
+    const unsigned LINE_WORDS = 8;
+    // words of a section before its bit-vectors: n, period, counts, bucket,
+    // zeros and padding, so that after the header and the raw offset the
+    // lines are cache lines of the (page aligned) mapping
+    const std::size_t FIXED_WORDS = 2 + 256 + 256 + 8 + 4;
+    static_assert((bw::FmIndex::HEADER_SIZE / 8 + 1 + FIXED_WORDS) % LINE_WORDS == 0, "aligned lines");
+
+    // without -mpopcnt the builtin is a library call
+    inline unsigned popcount(std::uint64_t x)
+    {
+        x -= (x >> 1) & 0x5555555555555555ull;
+        x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+        x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+        return (x * 0x0101010101010101ull) >> 56;
+    }
+
+    std::uint64_t lines(std::uint64_t n)
+    {
+        return n / LINE_BITS + 1;
+    }
+
+    std::uint64_t samples(std::uint64_t n)
+    {
+        return (n + bw::FmIndex::SAMPLE_RATE - 1) / bw::FmIndex::SAMPLE_RATE;
+    }
+
+    // bits of a sample, enough for a position or a row of a block of n bytes
+    unsigned sampleBits(std::uint64_t n)
+    {
+        unsigned width = 1;
+        while ((std::uint64_t(1) << width) < n)
+            width++;
+        return width;
+    }
+
+    // words of the samples of a block of n bytes, packed sampleBits(n) to a value
+    std::uint64_t sampleWords(std::uint64_t n)
+    {
+        return (samples(n) * sampleBits(n) + 63) / 64;
+    }
+
+    // words of the section of a block of n bytes, padded to whole lines
+    // with its raw offset so that those of the next section stay aligned
+    std::uint64_t sectionWords(std::uint64_t n)
+    {
+        const std::uint64_t words = 1 + FIXED_WORDS + 9 * LINE_WORDS * lines(n) + 2 * sampleWords(n);
+        return (words + LINE_WORDS - 1) / LINE_WORDS * LINE_WORDS - 1;
+    }
+
+    // ones of v before bit i, and bit i itself
+    inline std::uint64_t rank(const std::uint64_t *v, std::uint64_t i, unsigned &bit)
+    {
+        const std::uint64_t *line = v + i / LINE_BITS * LINE_WORDS;
+        const unsigned r = i % LINE_BITS, w = r / 64, b = r % 64;
+        const std::uint64_t word = line[1 + w];
+        bit = (word >> b) & 1;
+        // without branches: the count before word 0 is the zeros shifted in,
+        // and the word before an even one is the counts masked out
+        return (line[0] >> 32) + ((line[0] << 10 >> (10 * (w / 2))) & 0x3ff)
+            + popcount(line[w] & -std::uint64_t(w & 1)) + popcount(word & ((std::uint64_t(1) << b) - 1));
+    }
+
+    inline std::uint64_t rank(const std::uint64_t *v, std::uint64_t i)
+    {
+        unsigned bit;
+        return rank(v, i, bit);
+    }
+
+    // append n bits as lines; bits holds them 64 to a word
+    void appendBits(const std::vector<std::uint64_t> &bits, std::uint64_t n, std::vector<std::uint64_t> &out)
+    {
+        std::uint64_t ones = 0;
+        for (std::uint64_t l = 0; l < lines(n); l++) {
+            std::uint64_t words[LINE_WORDS - 1], counts = ones << 32, before = 0;
+            for (unsigned w = 0; w < LINE_WORDS - 1; w++) {
+                const std::uint64_t k = l * (LINE_WORDS - 1) + w;
+                words[w] = k < bits.size() ? bits[k] : 0;
+                if (w >= 2 && w % 2 == 0)
+                    counts |= before << (5 * w - 10);
+                before += popcount(words[w]);
+            }
+            out.push_back(counts);
+            out.insert(out.end(), words, words + LINE_WORDS - 1);
+            ones += before;
+        }
+    }
+
+    // append values of width bits each, from the low bits of a word up
+    void appendPacked(const std::vector<std::uint32_t> &values, unsigned width, std::vector<std::uint64_t> &out)
+    {
+        const std::size_t at = out.size();
+        out.resize(at + (values.size() * width + 63) / 64);
+        for (std::uint64_t k = 0; k < values.size(); k++) {
+            const std::uint64_t bit = k * width;
+            out[at + bit / 64] |= std::uint64_t(values[k]) << (bit % 64);
+            if (bit % 64 + width > 64)
+                out[at + bit / 64 + 1] |= std::uint64_t(values[k]) >> (64 - bit % 64);
+        }
+    }
+
+    // value k of those appended by appendPacked()
+    inline std::uint64_t unpack(const std::uint64_t *v, unsigned width, std::uint64_t k)
+    {
+        const std::uint64_t bit = k * width;
+        std::uint64_t x = v[bit / 64] >> (bit % 64);
+        if (bit % 64 + width > 64)
+            x |= v[bit / 64 + 1] << (64 - bit % 64);
+        return x & ((std::uint64_t(1) << width) - 1);
+    }
+
+    // smallest p dividing n such that block[0..n) repeats block[0..p); each
+    // prime of n is divided out of p for as long as p stays a period
+    std::uint64_t period(const char *block, std::uint64_t n)
+    {
+        std::uint64_t p = n, rest = n;
+        for (std::uint64_t q = 2; rest > 1; q++) {
+            if (q * q > rest)
+                q = rest;
+            if (rest % q != 0)
+                continue;
+            while (rest % q == 0)
+                rest /= q;
+            while (p % q == 0 && std::memcmp(block, block + p / q, n - p / q) == 0)
+                p /= q;
+        }
+        return p;
+    }
+
+    void appendWords(const std::vector<std::uint64_t> &words, std::string &out)
+    {
+        out.append(reinterpret_cast<const char *>(words.data()), words.size() * sizeof(std::uint64_t));
+    }
+
+    void corrupted()
+    {
+        throw std::runtime_error("Corrupted FM-index");
+    }
+}
+
+std::string bw::FmIndex::header()
+{
+    std::string head(MAGIC, sizeof(MAGIC));
+    head += char(VERSION);
+    head.append(3, '\0');
+    return head;
+}
+
+std::string bw::FmIndex::trailer(std::uint64_t blocks)
+{
+    std::string tail(reinterpret_cast<const char *>(&blocks), sizeof(blocks));
+    tail.append(END_MAGIC, sizeof(END_MAGIC));
+    return tail;
+}
+
+void bw::FmIndex::build(const CircularSuffixArray &cas, const char *block, const std::string &bwt,
+        std::string &out)
+{
+    const std::uint64_t n = bwt.size();
+    if (cas.length() != n || n > UINT32_MAX)
+        throw std::invalid_argument("Block too large for an FM-index");
+    BW_STATS_TIMER(timer, FM_INDEX, n);
+
+    std::vector<std::uint64_t> words;
+    words.reserve(sectionWords(n));
+    words.push_back(n);
+    words.push_back(period(block, n));
+    std::uint64_t counts[256] = {};
+    for (std::uint64_t i = 0; i < n; i++)
+        counts[static_cast<unsigned char>(bwt[i])]++;
+    words.insert(words.end(), counts, counts + 256);
+    const std::size_t bucketAt = words.size(), levelsAt = FIXED_WORDS;
+    words.resize(levelsAt);
+
+    // each level partitions the symbols stably on one bit, zeros first
+    std::vector<unsigned char> cur(bwt.begin(), bwt.end()), next(n);
+    std::vector<std::uint64_t> bits;
+    for (unsigned l = 0; l < LEVELS; l++) {
+        const unsigned shift = LEVELS - 1 - l;
+        bits.assign((n + 63) / 64, 0);
+        std::uint64_t zeros = 0;
+        for (std::uint64_t i = 0; i < n; i++)
+            if ((cur[i] >> shift) & 1)
+                bits[i / 64] |= std::uint64_t(1) << (i % 64);
+            else
+                zeros++;
+        std::uint64_t z = 0, o = zeros;
+        for (std::uint64_t i = 0; i < n; i++)
+            next[(cur[i] >> shift) & 1 ? o++ : z++] = cur[i];
+        cur.swap(next);
+        words[bucketAt + 256 + l] = zeros;
+        appendBits(bits, n, words);
+    }
+    // where a symbol lands after the last level, found the way queries follow it
+    for (unsigned c = 0; c < 256; c++) {
+        std::uint64_t e = 0;
+        for (unsigned l = 0; l < LEVELS; l++) {
+            const std::uint64_t *level = &words[levelsAt + l * LINE_WORDS * lines(n)];
+            const std::uint64_t ones = rank(level, e);
+            e = (c >> (LEVELS - 1 - l)) & 1 ? words[bucketAt + 256 + l] + ones : e - ones;
+        }
+        words[bucketAt + c] = e;
+    }
+
+    // rows of the rotations at multiples of SAMPLE_RATE, and the reverse
+    std::vector<std::uint32_t> positions, rows(samples(n));
+    positions.reserve(samples(n));
+    bits.assign((n + 63) / 64, 0);
+    for (std::uint64_t i = 0; i < n; i++) {
+        const std::uint64_t p = cas.index(i);
+        if (p % SAMPLE_RATE == 0) {
+            bits[i / 64] |= std::uint64_t(1) << (i % 64);
+            positions.push_back(p);
+            rows[p / SAMPLE_RATE] = i;
+        }
+    }
+    appendBits(bits, n, words);
+    appendPacked(positions, sampleBits(n), words);
+    appendPacked(rows, sampleBits(n), words);
+    words.resize(sectionWords(n));
+    appendWords(words, out);
+    BW_STATS_OUTPUT(timer, sectionWords(n) * sizeof(std::uint64_t));
+}
+
+bw::FmIndex::FmIndex(const std::string &path)
+    :file(new MappedFile(path))
+    ,length(0)
+{
+    if (!file->mapped())
+        throw std::runtime_error("FM-index must be a regular file");
+    const char *data = file->data();
+    const std::size_t size = file->size();
+    if (size < HEADER_SIZE + TRAILER_SIZE || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0)
+        throw std::runtime_error("Not an FM-index");
+    if (static_cast<unsigned char>(data[sizeof(MAGIC)]) != VERSION)
+        throw std::runtime_error("Unsupported FM-index version");
+    if (std::memcmp(data + size - sizeof(END_MAGIC), END_MAGIC, sizeof(END_MAGIC)) != 0)
+        throw std::runtime_error("Truncated FM-index");
+    std::uint64_t count;
+    std::memcpy(&count, data + size - TRAILER_SIZE, sizeof(count));
+
+    // the mapping is page aligned and every section a whole number of words
+    const std::uint64_t *word = reinterpret_cast<const std::uint64_t *>(data + HEADER_SIZE);
+    std::uint64_t left = (size - HEADER_SIZE - TRAILER_SIZE) / sizeof(std::uint64_t);
+    if ((size - HEADER_SIZE - TRAILER_SIZE) % sizeof(std::uint64_t) || count > left)
+        corrupted();
+    blocks.resize(count);
+    for (Block &b : blocks) {
+        if (left < 2)
+            corrupted();
+        b.rawOffset = word[0];
+        b.n = word[1];
+        word += 2;
+        left -= 2;
+        if (b.rawOffset != length || b.n > UINT32_MAX || sectionWords(b.n) - 1 > left)
+            corrupted();
+        b.period = word[0];
+        if (b.period > b.n || (b.n && (b.period == 0 || b.n % b.period)))
+            corrupted();
+        const std::uint64_t *counts = word + 1;
+        b.less[0] = 0;
+        for (unsigned c = 0; c < 256; c++)
+            b.less[c + 1] = b.less[c] + counts[c];
+        if (b.less[256] != b.n)
+            corrupted();
+        b.bucket = counts + 256;
+        b.zeros = b.bucket + 256;
+        for (unsigned l = 0; l < LEVELS; l++)
+            b.level[l] = word - 1 + FIXED_WORDS + l * LINE_WORDS * lines(b.n);
+        b.marks = b.level[LEVELS - 1] + LINE_WORDS * lines(b.n);
+        b.width = sampleBits(b.n);
+        b.positions = b.marks + LINE_WORDS * lines(b.n);
+        b.rows = b.positions + sampleWords(b.n);
+        for (unsigned c = 0; c < 256; c++)
+            if (b.bucket[c] > b.n)
+                corrupted();
+        for (unsigned l = 0; l < LEVELS; l++)
+            if (b.zeros[l] > b.n)
+                corrupted();
+        word += sectionWords(b.n) - 1;
+        left -= sectionWords(b.n) - 1;
+        length += b.n;
+    }
+    if (left != 0)
+        corrupted();
+}
+
+bw::FmIndex::~FmIndex()
+{
+}
+
+std::uint64_t bw::FmIndex::lf(const Block &b, std::uint64_t i, unsigned char &c) const
+{
+    // the path of row i through the levels spells its symbol and ends
+    // among the symbols equal to it, in row order
+    std::uint64_t e = i;
+    unsigned symbol = 0;
+    for (unsigned l = 0; l < LEVELS; l++) {
+        unsigned bit;
+        const std::uint64_t ones = rank(b.level[l], e, bit);
+        e = bit ? b.zeros[l] + ones : e - ones;
+        symbol = symbol << 1 | bit;
+        if (e > b.n)
+            corrupted();
+    }
+    c = symbol;
+    const std::uint64_t row = b.less[symbol] + e - b.bucket[symbol];
+    if (row >= b.n)
+        corrupted();
+    return row;
+}
+
+std::uint64_t bw::FmIndex::position(const Block &b, std::uint64_t i) const
+{
+    // walking back reaches a multiple of SAMPLE_RATE before position 0 wraps
+    for (unsigned steps = 0; steps < SAMPLE_RATE; steps++) {
+        unsigned marked;
+        const std::uint64_t k = rank(b.marks, i, marked);
+        if (marked) {
+            const std::uint64_t p = k < samples(b.n) ? unpack(b.positions, b.width, k) : b.n;
+            if (p + steps >= b.n)
+                corrupted();
+            return p + steps;
+        }
+        unsigned char c;
+        i = lf(b, i, c);
+    }
+    corrupted();
+    return 0;
+}
+
+std::string bw::FmIndex::extractBlock(const Block &b, std::uint64_t from, std::uint64_t to) const
+{
+    std::string out(to - from, '\0');
+    if (from >= to)
+        return out;
+    // start at the first sampled rotation at or after to, or at the end
+    std::uint64_t pos = (to + SAMPLE_RATE - 1) / SAMPLE_RATE * SAMPLE_RATE;
+    std::uint64_t row = unpack(b.rows, b.width, pos < b.n ? pos / SAMPLE_RATE : 0);
+    if (pos >= b.n)
+        pos = b.n;
+    if (row >= b.n)
+        corrupted();
+    while (pos > from) {
+        unsigned char c;
+        row = lf(b, row, c);
+        if (--pos < to)
+            out[pos - from] = c;
+    }
+    return out;
+}
+
+std::string bw::FmIndex::extract(std::uint64_t offset, std::size_t n) const
+{
+    std::string out;
+    if (offset >= length)
+        return out;
+    const std::uint64_t end = offset + std::min<std::uint64_t>(n, length - offset);
+    out.reserve(end - offset);
+    // the last block starting at or before offset
+    std::size_t k = std::upper_bound(blocks.begin(), blocks.end(), offset,
+            [](std::uint64_t v, const Block &b) { return v < b.rawOffset; }) - blocks.begin() - 1;
+    for (; k < blocks.size() && blocks[k].rawOffset < end; k++) {
+        const Block &b = blocks[k];
+        const std::uint64_t from = std::max(offset, b.rawOffset) - b.rawOffset;
+        const std::uint64_t to = std::min(end - b.rawOffset, b.n);
+        out += extractBlock(b, from, to);
+    }
+    return out;
+}
+
+std::uint64_t bw::FmIndex::search(const Block &b, const std::string &pattern, std::vector<std::uint64_t> *offsets) const
+{
+    const std::size_t m = pattern.size();
+    if (m > b.n)
+        return 0;
+    if (b.period < b.n)
+        return searchRepeated(b, pattern, offsets);
+    // backward search: rows [sp, ep) are the rotations starting with the
+    // suffix of the pattern read so far; both ends follow one path
+    std::uint64_t sp = 0, ep = b.n;
+    for (std::size_t j = m; j-- > 0 && sp < ep; ) {
+        const unsigned c = static_cast<unsigned char>(pattern[j]);
+        for (unsigned l = 0; l < LEVELS; l++) {
+            const std::uint64_t s = rank(b.level[l], sp), e = rank(b.level[l], ep);
+            if ((c >> (LEVELS - 1 - l)) & 1) {
+                sp = b.zeros[l] + s;
+                ep = b.zeros[l] + e;
+            }
+            else {
+                sp -= s;
+                ep -= e;
+            }
+            if (sp > b.n || ep > b.n)
+                corrupted();
+        }
+        sp = b.less[c] + sp - b.bucket[c];
+        ep = b.less[c] + ep - b.bucket[c];
+        if (sp > ep || ep > b.n)
+            corrupted();
+    }
+    if (sp == ep)
+        return 0;
+
+    if (offsets != nullptr) {
+        std::uint64_t found = 0;
+        for (std::uint64_t i = sp; i < ep; i++) {
+            const std::uint64_t p = position(b, i);
+            if (p + m <= b.n) {
+                offsets->push_back(b.rawOffset + p);
+                found++;
+            }
+        }
+        return found;
+    }
+
+    // the rotations that only match by wrapping start in the last m - 1 bytes
+    std::uint64_t wrapped = 0;
+    if (m > 1) {
+        const std::string around = extractBlock(b, b.n - (m - 1), b.n) + extractBlock(b, 0, m - 1);
+        for (std::size_t s = 0; s + 1 < m; s++)
+            wrapped += around.compare(s, m, pattern) == 0;
+    }
+    return ep - sp - wrapped;
+}
+
+std::uint64_t bw::FmIndex::searchRepeated(const Block &b, const std::string &pattern,
+        std::vector<std::uint64_t> *offsets) const
+{
+    // an occurrence at q < period recurs every period bytes
+    const std::size_t m = pattern.size();
+    const std::string unit = extractBlock(b, 0, b.period);
+    std::string text;
+    while (text.size() < b.period + m - 1)
+        text += unit;
+    std::uint64_t found = 0;
+    for (std::uint64_t q = 0; q < b.period; q++) {
+        if (text.compare(q, m, pattern) != 0 || q + m > b.n)
+            continue;
+        found += (b.n - m - q) / b.period + 1;
+        if (offsets != nullptr)
+            for (std::uint64_t s = q; s + m <= b.n; s += b.period)
+                offsets->push_back(b.rawOffset + s);
+    }
+    return found;
+}
+
+std::uint64_t bw::FmIndex::straddling(std::size_t k, const std::string &pattern,
+        std::vector<std::uint64_t> *offsets) const
+{
+    // occurrences starting in block k and ending in a later one
+    const std::size_t m = pattern.size();
+    const std::uint64_t boundary = blocks[k + 1].rawOffset;
+    const std::uint64_t from = std::max(boundary - std::min<std::uint64_t>(boundary, m - 1), blocks[k].rawOffset);
+    const std::string around = extract(from, boundary + (m - 1) - from);
+    std::uint64_t found = 0;
+    for (std::uint64_t s = 0; from + s < boundary && s + m <= around.size(); s++)
+        if (around.compare(s, m, pattern) == 0) {
+            if (offsets != nullptr)
+                offsets->push_back(from + s);
+            found++;
+        }
+    return found;
+}
+
+std::uint64_t bw::FmIndex::count(const std::string &pattern) const
+{
+    if (pattern.empty())
+        throw std::invalid_argument("Empty pattern");
+    std::uint64_t total = 0;
+    for (std::size_t k = 0; k < blocks.size(); k++) {
+        total += search(blocks[k], pattern, nullptr);
+        if (pattern.size() > 1 && k + 1 < blocks.size())
+            total += straddling(k, pattern, nullptr);
+    }
+    return total;
+}
+
+void bw::FmIndex::locate(const std::string &pattern, std::vector<std::uint64_t> &offsets) const
+{
+    if (pattern.empty())
+        throw std::invalid_argument("Empty pattern");
+    offsets.clear();
+    for (std::size_t k = 0; k < blocks.size(); k++) {
+        search(blocks[k], pattern, &offsets);
+        if (pattern.size() > 1 && k + 1 < blocks.size())
+            straddling(k, pattern, &offsets);
+    }
+    std::sort(offsets.begin(), offsets.end());
+}
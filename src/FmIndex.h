@@ -0,0 +1,125 @@
+#ifndef _FMINDEX_H_
+#define _FMINDEX_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace bw
+{
+    class CircularSuffixArray;
+    class MappedFile;
+
+    // FM-index of the blocks of a compressed stream, written to a file of its
+    // own as the stream is compressed (bw -c -x) and searched by bwgrep
+    // without expanding anything.
+    //
+    // A block keeps the last column of its transform as a wavelet matrix:
+    // eight bit-vectors, one per bit of the symbols, each with the count of
+    // ones before every 448 bits sampled in the same 64-byte line as the
+    // bits, so one rank is one cache line and at most two popcounts, for
+    // under 15% over the bits themselves. The rows of rotations
+    // that start at a multiple of SAMPLE_RATE are marked in a ninth
+    // bit-vector and keep that position, and those rotations keep their row,
+    // so locating a row and extracting text both take fewer than SAMPLE_RATE
+    // LF steps beyond the bytes asked for; both are packed in as few bits as
+    // the block's length needs. As the transform is circular,
+    // matches that wrap around the end of a block are dropped, and matches
+    // that cross from one block into the next are found in the text
+    // extracted around the boundary. A block that is a shorter string
+    // repeated has identical rotations, in no particular order, so it is
+    // searched in one extracted period instead.
+    //
+    // File layout (host byte order, 64-bit words):
+    //   header  "BWFI" version:8 0:24
+    //   block   raw_offset n period counts[256] bucket[256] zeros[8] 0[4] levels[8][lines] marks[lines]
+    //           positions[samples]:width rows[samples]:width, each padded to a word
+    //           and the block to whole lines, so that every line starts at a multiple of 64 bytes
+    //   ...
+    //   trailer count "BWFIEND\0"
+    // with lines = n / 448 + 1 lines of 8 words, samples = ceil(n / SAMPLE_RATE)
+    // and width = ceil(log2(n)) bits, at least 1.
+    class FmIndex {
+        public:
+            // one text position in this many is sampled
+            static const unsigned SAMPLE_RATE = 32;
+            static const std::size_t HEADER_SIZE = 8;
+            static const std::size_t TRAILER_SIZE = 16;
+
+        private:
+            static const unsigned LEVELS = 8;
+
+            // a block's section, viewed in the mapped file
+            struct Block {
+                std::uint64_t rawOffset;
+                std::uint64_t n;
+                std::uint64_t period;           // smallest p such that the block repeats p bytes
+                std::uint64_t less[257];        // symbols of the block less than c
+                const std::uint64_t *bucket;    // where c ends up after the last level
+                const std::uint64_t *zeros;
+                const std::uint64_t *level[LEVELS];
+                const std::uint64_t *marks;
+                unsigned width;                 // bits of a position or a row
+                const std::uint64_t *positions; // of the marked rows, in row order
+                const std::uint64_t *rows;      // of the rotations at k * SAMPLE_RATE
+            };
+
+            std::unique_ptr<MappedFile> file;
+            std::vector<Block> blocks;
+            std::uint64_t length;
+
+        public:
+            FmIndex(const FmIndex &that)=delete;
+            FmIndex &operator=(const FmIndex &that)=delete;
+
+            // map an index file; throws if it is not one
+            explicit FmIndex(const std::string &path);
+            ~FmIndex();
+
+            // append the section of block[0..n), without its raw offset, given
+            // its suffix array and its transform
+            void static build(const CircularSuffixArray &cas, const char *block, const std::string &bwt,
+                    std::string &out);
+            // what comes before the first block and after the last
+            std::string static header();
+            std::string static trailer(std::uint64_t blocks);
+
+            // bytes of original data covered
+            std::uint64_t size() const { return length; }
+
+            // number of occurrences of pattern in the original data
+            std::uint64_t count(const std::string &pattern) const;
+
+            // offsets of the occurrences of pattern, in increasing order
+            void locate(const std::string &pattern, std::vector<std::uint64_t> &offsets) const;
+
+            // bytes [offset, offset + n) of the original data, clipped to its size
+            std::string extract(std::uint64_t offset, std::size_t n) const;
+
+        private:
+            // occurrences wholly inside block b: rows [sp, ep) of the backward
+            // search, and with offsets also their raw offsets; returns the number
+            std::uint64_t search(const Block &b, const std::string &pattern, std::vector<std::uint64_t> *offsets) const;
+
+            // the same in a block repeating a shorter string
+            std::uint64_t searchRepeated(const Block &b, const std::string &pattern,
+                    std::vector<std::uint64_t> *offsets) const;
+
+            // occurrences that cross from block k into block k + 1
+            std::uint64_t straddling(std::size_t k, const std::string &pattern,
+                    std::vector<std::uint64_t> *offsets) const;
+
+            // bytes [from, to) of block b, to <= b.n
+            std::string extractBlock(const Block &b, std::uint64_t from, std::uint64_t to) const;
+
+            // symbol of row i and the row of the rotation one position earlier
+            std::uint64_t lf(const Block &b, std::uint64_t i, unsigned char &c) const;
+
+            // text position of the rotation at row i
+            std::uint64_t position(const Block &b, std::uint64_t i) const;
+    };
+}
+
+#endif
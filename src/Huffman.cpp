@@ -1,8 +1,10 @@
 #include "Huffman.h"
 
 const int  bw::Huffman::R;
-
-bool bw::operator<(const bw::Node_ptr &a, const bw::Node_ptr &b)
-{
-    return a->compareTo(b.get()) < 0;
-}
+const unsigned bw::Huffman::MAX_CODE_LENGTH;
+const unsigned bw::Huffman::MAX_SYMBOLS;
+const unsigned bw::Huffman::GROUP_SIZE;
+const unsigned bw::Huffman::MAX_TABLES;
+const unsigned bw::Huffman::ITERATIONS;
+const unsigned bw::Huffman::MAX_STREAMS;
+const unsigned bw::Huffman::COST_BITS;
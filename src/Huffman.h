@@ -1,95 +1,46 @@
 #ifndef _HUFFMAN_H_
 #define _HUFFMAN_H_
 
-#include <functional>
 #include <cstring>
+#include <cstdint>
 #include <string>
-#include <sstream>
-#include <cassert>
-#include <stdexcept>
 #include <vector>
-#include <queue>
-#include <memory>
+#include <stdexcept>
+#include <algorithm>
 #include <iostream>
 
 #include "ostreambin.h"
 #include "istreambin.h"
+#include "BitWriter.h"
+#include "BitReader.h"
+#include "HuffmanDecoder.h"
+#include "Stats.h"
 
 namespace bw {
-    class Node
-    {
-        public:
-            unsigned char ch;
-            int freq;
-            std::unique_ptr<Node> left, right;
-
-            Node(char _ch, int _freq, std::unique_ptr<Node> &_left, std::unique_ptr<Node> &_right)
-                :ch(_ch)
-                 ,freq(_freq)
-                 ,left(std::move(_left))
-                 ,right(std::move(_right))
-            {
-            }
-
-            Node(char _ch, int _freq, std::unique_ptr<Node> &&_left, std::unique_ptr<Node> &&_right)
-                :ch(_ch)
-                 ,freq(_freq)
-                 ,left(std::move(_left))
-                 ,right(std::move(_right))
-            {
-            }
-
-            Node(char _ch, int _freq)
-                :ch(_ch)
-                 ,freq(_freq)
-            {
-            }
-
-            Node(std::unique_ptr<Node> & that)
-                :ch(that->ch)
-                 ,freq(that->freq)
-                 ,left(std::move(that->left))
-                 ,right(std::move(that->right))
-        {
-        }
-
-            // compare, based on frequency
-            int compareTo(const Node &that) const
-            {
-                return this->freq - that.freq;
-            }
-
-            int compareTo(const Node *that) const
-            {
-                return this->freq - that->freq;
-            }
-
-            // is the node a leaf node?
-            bool isLeaf() {
-                assert (((left == nullptr) && (right == nullptr)) || ((left != nullptr) && (right != nullptr)));
-                return (left == nullptr) && (right == nullptr);
-            }
-
-    };
-    typedef unsigned char UCHAR;
-    typedef std::unique_ptr<Node> Node_ptr;
-
-
-    bool operator<(const bw::Node_ptr &a, const bw::Node_ptr &b);
-
     class Huffman {
 
         // alphabet size of extended ASCII
         private:
             static const int R = 256;
 
+        public:
+            // longest codeword; lengths are stored in 4 bits
+            static const unsigned MAX_CODE_LENGTH = 15;
+            // largest alphabet; the length bitmap has one bit per 16 symbols
+            static const unsigned MAX_SYMBOLS = 512;
+            // multiple tables: symbols per selector, most tables, refinement passes
+            static const unsigned GROUP_SIZE = 50;
+            static const unsigned MAX_TABLES = 6;
+            static const unsigned ITERATIONS = 4;
+            // most bitstreams of compressStreams()
+            static const unsigned MAX_STREAMS = 8;
+
         private:
             // Do not instantiate.
             Huffman()
             {
             }
 
-            // Huffman trie node
             /*
              * Reads a sequence of 8-bit bytes from standard input; compresses them
              * using Huffman codes with an 8-bit alphabet; and writes the results
@@ -100,148 +51,717 @@ namespace bw {
                 // read the input
                 std::string input(std::istreambuf_iterator<char>(*(streamin.getStream())), {});
 
+                std::string packed;
+                BitWriter out(packed);
+                compress(reinterpret_cast<const unsigned char *>(input.data()), input.size(), out);
+                out.flush();
+
+                streamout.write(packed.data(), packed.size());
+
+                // close output stream
+                streamout.flush();
+            }
+
+            // compress in[0..n) to out: number of bytes, code lengths, then the codewords
+            void static compress(const unsigned char *in, std::size_t n, BitWriter &out) {
+                compress(in, n, R, out);
+            }
+
+            // compress n symbols of an alphabet of the given size (at most MAX_SYMBOLS)
+            template <typename T>
+            void static compress(const T *in, std::size_t n, unsigned symbols, BitWriter &out) {
+                if (symbols > MAX_SYMBOLS)
+                    throw std::invalid_argument("Huffman alphabet too large");
+                BW_STATS_TIMER(timer, HUFFMAN_ENCODE, n);
+                BW_STATS_ONLY(const std::uint64_t start = out.bitCount());
+
                 // tabulate frequency counts
-                int freq[R];
+                std::uint64_t freq[MAX_SYMBOLS];
                 std::memset(freq, 0, sizeof(freq));
-                for (unsigned i = 0; i < input.size(); i++)
+                for (std::size_t i = 0; i < n; i++)
                 {
-                    freq[(UCHAR)input[i]]++;
+                    freq[in[i]]++;
                 }
 
-                // build Huffman trie
-                Node_ptr root(buildTrie(freq));
+                // build the canonical code
+                unsigned len[MAX_SYMBOLS];
+                std::uint32_t code[MAX_SYMBOLS];
+                buildLengths(freq, len, symbols);
+                buildCode(len, code, symbols);
 
-                // build code table
-                std::vector<std::string> st(R);
-                buildCode(st, root, "");
+                // print number of symbols in original uncompressed message
+                writeLength(n, out);
 
-                // print trie for decoder
-                writeTrie(root, streamout);
-
-                // print number of bytes in original uncompressed message
-                const unsigned input_size = input.size();
-                streamout.write(reinterpret_cast<const char*>(&input_size), sizeof(input_size));
+                // print code lengths for decoder
+                writeLengths(len, symbols, out);
 
                 // use Huffman code to encode input
-                unsigned char val;
-                for (unsigned i = 0; i < input.size(); ++i) {
-                    const std::string &code = st[((UCHAR)input[i])];
-                    for (unsigned j = 0; j < code.size(); j++) {
-                        if((val = code[j]-'0') > 1)
-                            throw std::invalid_argument(std::string("Illegal state [Code: " + code + "]"));
-                        streamout.write((char)val);
-                    }
-                }
+                for (std::size_t i = 0; i < n; ++i)
+                    out.writeBits(code[in[i]], len[in[i]]);
+                BW_STATS_OUTPUT(timer, (out.bitCount() - start) / 8);
+                BW_STATS_ADD(SYMBOLS, n);
+            }
 
-                // close output stream
+            /**
+             * Reads a sequence of bits that represents a Huffman-compressed message from
+             * standard input; expands them; and writes the results to standard output.
+             **/
+            void static expand(istreambin &streamin, ostreambin &streamout) {
+                streamin.fillbuffer();
+
+                // decode the whole input from memory
+                std::string input, output;
+                const int skip = streamin.readRemaining(input);
+                BitReader in(input.data(), input.size());
+                in.readBits(skip);
+
+                expand(in, output);
+
+                streamout.getStream()->write(output.data(), output.size());
                 streamout.flush();
             }
 
-        private:
-            // build the Huffman trie given frequencies
-            static Node *buildTrie(const int *freq) {
-                // initialze priority queue with singleton trees
-                std::priority_queue<Node_ptr, std::vector<Node_ptr>, std::greater<Node_ptr>> pq;
+            // expand one message written by compress(in, n, out)
+            void static expand(BitReader &in, std::string &out) {
+                BW_STATS_TIMER(timer, HUFFMAN_DECODE, 0);
+                BW_STATS_ONLY(const std::uint64_t start = in.bitCount());
+                std::size_t length;
+                const HuffmanDecoder decoder = readHeader(in, R, length);
+
+                out.resize(length);
+                decoder.decode(in, reinterpret_cast<unsigned char *>(&out[0]), length);
+                BW_STATS_INPUT(timer, (in.bitCount() - start) / 8);
+                BW_STATS_OUTPUT(timer, length);
+            }
 
-                for (int i = 0; i < R; i++)
-                    if (freq[i] > 0)
-                        pq.emplace(new Node(i, freq[i]));
-                // special case in case there is only one character with a nonzero frequency
-                if (pq.size() == 1) {
-                    pq.emplace(new Node(!!freq[0], 0));
+            // expand one message written by compress(in, n, symbols, out)
+            void static expand(BitReader &in, std::vector<std::uint16_t> &out, unsigned symbols) {
+                BW_STATS_TIMER(timer, HUFFMAN_DECODE, 0);
+                BW_STATS_ONLY(const std::uint64_t start = in.bitCount());
+                std::size_t length;
+                const HuffmanDecoder decoder = readHeader(in, symbols, length);
+
+                out.resize(length);
+                decoder.decode(in, out.data(), length);
+                BW_STATS_INPUT(timer, (in.bitCount() - start) / 8);
+                BW_STATS_OUTPUT(timer, length);
+            }
+
+            // Compress with up to MAX_TABLES codes, one selected per group of
+            // GROUP_SIZE symbols, as in bzip2: number of symbols, number of
+            // tables, the selectors, the code lengths of every table, then the
+            // codewords. Tables start from a split of the alphabet by frequency
+            // and are refined over ITERATIONS passes of picking the cheapest
+            // table per group and rebuilding each table from its groups.
+            template <typename T>
+            void static compressTables(const T *in, std::size_t n, unsigned symbols, BitWriter &out) {
+                if (symbols > MAX_SYMBOLS)
+                    throw std::invalid_argument("Huffman alphabet too large");
+                BW_STATS_TIMER(timer, HUFFMAN_ENCODE, n);
+                BW_STATS_ONLY(const std::uint64_t start = out.bitCount());
+
+                // one block's worth of symbols, counted in 32 bits
+                if (n > UINT32_MAX)
+                    throw std::length_error("Huffman block too large");
+                const std::size_t groups = (n + GROUP_SIZE - 1) / GROUP_SIZE;
+                std::vector<unsigned char> selector;
+                std::uint64_t tableFreq[MAX_TABLES][MAX_SYMBOLS];
+                unsigned len[MAX_TABLES][MAX_SYMBOLS];
+                const unsigned tables = selectTables(in, n, symbols, selector, tableFreq, len);
+
+                std::uint32_t code[MAX_TABLES][MAX_SYMBOLS];
+                for (unsigned t = 0; t < tables; t++)
+                    buildCode(len[t], code[t], symbols);
+
+                out.writeBits(n, 32);
+                out.writeBits(tables, 3);
+                writeSelectors(selector, tables, out);
+                for (unsigned t = 0; t < tables; t++)
+                    writeLengths(len[t], symbols, out);
+
+                for (std::size_t g = 0; g < groups; g++) {
+                    const unsigned *l = len[selector[g]];
+                    const std::uint32_t *c = code[selector[g]];
+                    const std::size_t end = std::min(n, (g + 1) * GROUP_SIZE);
+                    for (std::size_t i = g * GROUP_SIZE; i < end; i++)
+                        out.writeBits(c[in[i]], l[in[i]]);
                 }
+                BW_STATS_OUTPUT(timer, (out.bitCount() - start) / 8);
+                BW_STATS_ADD(SYMBOLS, n);
+            }
 
-                // merge two smallest trees
-                while (pq.size() > 1) {
-                    Node_ptr left(std::move(const_cast<Node_ptr&>(pq.top()))); pq.pop();
-                    Node_ptr right(std::move(const_cast<Node_ptr&>(pq.top()))); pq.pop();
-                    pq.emplace(new Node('\0', left->freq + right->freq, left, right));
+            // expand one message written by compressTables(); out is a
+            // std::string or a std::vector<std::uint16_t>, refusing more than
+            // limit symbols
+            template <typename Buffer>
+            void static expandTables(BitReader &in, Buffer &out, unsigned symbols, std::size_t limit) {
+                if (symbols > MAX_SYMBOLS)
+                    throw std::invalid_argument("Huffman alphabet too large");
+                BW_STATS_TIMER(timer, HUFFMAN_DECODE, 0);
+                BW_STATS_ONLY(const std::uint64_t start = in.bitCount());
+
+                const std::size_t length = in.readBits(32);
+                if (length > limit)
+                    throw std::runtime_error("Huffman message too long");
+                std::vector<unsigned char> selector;
+                std::vector<HuffmanDecoder> decoders;
+                readTables(in, length, symbols, selector, decoders);
+
+                out.resize(length);
+                for (std::size_t g = 0; g < selector.size(); g++) {
+                    const std::size_t begin = g * GROUP_SIZE;
+                    const std::size_t count = std::min<std::size_t>(GROUP_SIZE, length - begin);
+                    decoders[selector[g]].decode(in, &out[begin], count);
                 }
+                BW_STATS_INPUT(timer, (in.bitCount() - start) / 8);
+                BW_STATS_OUTPUT(timer, length);
+            }
 
-                Node_ptr ret = std::move(const_cast<Node_ptr&>(pq.top())); pq.pop();
-                return ret.release();
+            // Like compressTables(), with the groups split into up to streams
+            // (1..MAX_STREAMS) runs of consecutive groups, each coded into a
+            // bitstream of its own: number of symbols, number of streams, the
+            // tables as in compressTables(), then, byte aligned, the byte size
+            // of every stream and the streams. Each stream is a separate chain
+            // of codeword boundaries, so the decoder advances them all in one
+            // loop and the processor overlaps their lookups.
+            template <typename T>
+            void static compressStreams(const T *in, std::size_t n, unsigned symbols, unsigned streams,
+                    BitWriter &out) {
+                if (symbols > MAX_SYMBOLS)
+                    throw std::invalid_argument("Huffman alphabet too large");
+                if (streams == 0 || streams > MAX_STREAMS)
+                    throw std::invalid_argument("Huffman stream count out of range");
+                if (n > UINT32_MAX)
+                    throw std::length_error("Huffman block too large");
+                BW_STATS_TIMER(timer, HUFFMAN_ENCODE, n);
+                BW_STATS_ONLY(const std::uint64_t start = out.bitCount());
+
+                const std::size_t groups = (n + GROUP_SIZE - 1) / GROUP_SIZE;
+                std::vector<unsigned char> selector;
+                std::uint64_t tableFreq[MAX_TABLES][MAX_SYMBOLS];
+                unsigned len[MAX_TABLES][MAX_SYMBOLS];
+                const unsigned tables = selectTables(in, n, symbols, selector, tableFreq, len);
+
+                std::uint32_t code[MAX_TABLES][MAX_SYMBOLS];
+                for (unsigned t = 0; t < tables; t++)
+                    buildCode(len[t], code[t], symbols);
+
+                // as many streams as it takes at this many groups each, none empty
+                const std::size_t perStream = (groups + streams - 1) / streams;
+                if (groups)
+                    streams = (groups + perStream - 1) / perStream;
+
+                out.writeBits(n, 32);
+                out.writeBits(streams - 1, 3);
+                out.writeBits(tables, 3);
+                writeSelectors(selector, tables, out);
+                for (unsigned t = 0; t < tables; t++)
+                    writeLengths(len[t], symbols, out);
+                out.align();
+
+                std::string packed[MAX_STREAMS];
+                for (unsigned s = 0; s < streams; s++) {
+                    BitWriter stream(packed[s]);
+                    const std::size_t last = std::min(groups, (s + 1) * perStream);
+                    for (std::size_t g = s * perStream; g < last; g++) {
+                        const unsigned *l = len[selector[g]];
+                        const std::uint32_t *c = code[selector[g]];
+                        const std::size_t end = std::min(n, (g + 1) * GROUP_SIZE);
+                        for (std::size_t i = g * GROUP_SIZE; i < end; i++)
+                            stream.writeBits(c[in[i]], l[in[i]]);
+                    }
+                    stream.flush();
+                    if (packed[s].size() > UINT32_MAX)
+                        throw std::length_error("Huffman stream too large");
+                    out.writeBits(packed[s].size(), 32);
+                }
+                for (unsigned s = 0; s < streams; s++)
+                    out.write(packed[s].data(), packed[s].size());
+                BW_STATS_OUTPUT(timer, (out.bitCount() - start) / 8);
+                BW_STATS_ADD(SYMBOLS, n);
             }
 
-            // write bitstring-encoded trie to standard output
-            void static writeTrie(const Node_ptr &x, ostreambin &streamout) {
-                if (x->isLeaf()) {
-                    //BinaryStdOut.write(true);
-                    //BinaryStdOut.write(x.ch, 8);
-                    streamout.write(true);
-                    streamout.write((char)x->ch);
+            // expand one message written by compressStreams() from in[0..n)
+            // into out, a std::string or a std::vector<std::uint16_t>, refusing
+            // more than limit symbols; returns the number of bytes read
+            template <typename Buffer>
+            std::size_t static expandStreams(const unsigned char *in, std::size_t n, Buffer &out, unsigned symbols,
+                    std::size_t limit) {
+                if (symbols > MAX_SYMBOLS)
+                    throw std::invalid_argument("Huffman alphabet too large");
+                BW_STATS_TIMER(timer, HUFFMAN_DECODE, 0);
+
+                BitReader header(in, n);
+                const std::size_t length = header.readBits(32);
+                const unsigned streams = header.readBits(3) + 1;
+                if (length > limit)
+                    throw std::runtime_error("Huffman message too long");
+                std::vector<unsigned char> selector;
+                std::vector<HuffmanDecoder> decoders;
+                readTables(header, length, symbols, selector, decoders);
+                header.align();
+
+                std::uint32_t size[MAX_STREAMS];
+                for (unsigned s = 0; s < streams; s++)
+                    size[s] = header.readBits(32);
+                if (header.overrun())
+                    throw std::runtime_error("Truncated Huffman header");
+                std::size_t at = header.bitCount() / 8;
+                const unsigned char *data[MAX_STREAMS];
+                for (unsigned s = 0; s < streams; s++) {
+                    if (size[s] > n - at)
+                        throw std::runtime_error("Truncated Huffman stream");
+                    data[s] = in + at;
+                    at += size[s];
+                }
+
+                out.resize(length);
+                bool complete = false;
+                switch (streams) {
+                    case 1: complete = decodeStreams<1>(data, size, decoders, selector, length, &out[0]); break;
+                    case 2: complete = decodeStreams<2>(data, size, decoders, selector, length, &out[0]); break;
+                    case 3: complete = decodeStreams<3>(data, size, decoders, selector, length, &out[0]); break;
+                    case 4: complete = decodeStreams<4>(data, size, decoders, selector, length, &out[0]); break;
+                    case 5: complete = decodeStreams<5>(data, size, decoders, selector, length, &out[0]); break;
+                    case 6: complete = decodeStreams<6>(data, size, decoders, selector, length, &out[0]); break;
+                    case 7: complete = decodeStreams<7>(data, size, decoders, selector, length, &out[0]); break;
+                    case 8: complete = decodeStreams<8>(data, size, decoders, selector, length, &out[0]); break;
+                }
+                if (!complete)
+                    throw std::runtime_error("Truncated Huffman stream");
+                BW_STATS_INPUT(timer, at);
+                BW_STATS_OUTPUT(timer, length);
+                return at;
+            }
+
+            // Optimal code lengths limited to MAX_CODE_LENGTH for the given
+            // frequencies (0 for unused symbols). Works in place on fixed
+            // size arrays, without allocating.
+            void static buildLengths(const std::uint64_t *freq, unsigned *len, unsigned symbols) {
+                // used symbols by ascending frequency
+                std::uint64_t a[MAX_SYMBOLS];
+                unsigned sym[MAX_SYMBOLS];
+                unsigned n = 0;
+                for (unsigned i = 0; i < symbols; i++) {
+                    len[i] = 0;
+                    if (freq[i] > 0)
+                        sym[n++] = i;
+                }
+                if (n == 0)
+                    return;
+                if (n == 1) {
+                    len[sym[0]] = 1;
                     return;
                 }
+                std::sort(sym, sym + n, [freq](unsigned x, unsigned y) {
+                    return freq[x] < freq[y] || (freq[x] == freq[y] && x < y);
+                });
+                for (unsigned i = 0; i < n; i++)
+                    a[i] = freq[sym[i]];
+
+                minimumRedundancy(a, n);
+
+                // histogram of lengths, folding everything too long into MAX_CODE_LENGTH
+                unsigned count[MAX_CODE_LENGTH + 1];
+                std::memset(count, 0, sizeof(count));
+                for (unsigned i = 0; i < n; i++)
+                    count[a[i] < MAX_CODE_LENGTH ? a[i] : MAX_CODE_LENGTH]++;
+
+                // restore the Kraft equality: each step pushes one code from MAX_CODE_LENGTH
+                // out and splits the deepest shorter code into two one level deeper
+                std::uint32_t total = 0;
+                for (unsigned l = MAX_CODE_LENGTH; l > 0; l--)
+                    total += count[l] << (MAX_CODE_LENGTH - l);
+                while (total != (1u << MAX_CODE_LENGTH)) {
+                    count[MAX_CODE_LENGTH]--;
+                    for (unsigned l = MAX_CODE_LENGTH - 1; l > 0; l--)
+                        if (count[l]) {
+                            count[l]--;
+                            count[l + 1] += 2;
+                            break;
+                        }
+                    total--;
+                }
 
-                streamout.write(false);
-                writeTrie(x->left, streamout);
-                writeTrie(x->right, streamout);
+                // the least frequent symbols get the longest codes
+                unsigned i = 0;
+                for (unsigned l = MAX_CODE_LENGTH; l > 0; l--)
+                    for (unsigned k = 0; k < count[l]; k++)
+                        len[sym[i++]] = l;
             }
 
-            // make a lookup table from symbols and their encodings
-            void static buildCode(std::vector<std::string> &st, Node_ptr const &x, const std::string &s) {
-                if (!x->isLeaf()) {
-                    buildCode(st, x->left,  s + "0");
-                    buildCode(st, x->right, s + "1");
+            // canonical codewords: by length, then by symbol
+            void static buildCode(const unsigned *len, std::uint32_t *code, unsigned symbols) {
+                std::uint32_t count[MAX_CODE_LENGTH + 1], next[MAX_CODE_LENGTH + 1];
+                std::memset(count, 0, sizeof(count));
+                for (unsigned i = 0; i < symbols; i++)
+                    count[len[i]]++;
+                count[0] = 0;
+
+                std::uint32_t c = 0;
+                for (unsigned l = 1; l <= MAX_CODE_LENGTH; l++) {
+                    c = (c + count[l - 1]) << 1;
+                    next[l] = c;
                 }
-                else {
-                    st[x->ch] = s;
+                for (unsigned i = 0; i < symbols; i++)
+                    code[i] = len[i] ? next[len[i]]++ : 0;
+            }
+
+            // The table of every group of GROUP_SIZE symbols and the code lengths
+            // of every table, as compressTables() writes them; tableFreq[t] counts
+            // the symbols of the groups of table t. Returns the number of tables.
+            template <typename T>
+            unsigned static selectTables(const T *in, std::size_t n, unsigned symbols,
+                    std::vector<unsigned char> &selector, std::uint64_t (*tableFreq)[MAX_SYMBOLS],
+                    unsigned (*len)[MAX_SYMBOLS]) {
+                const unsigned tables = tableCount(n);
+                const std::size_t groups = (n + GROUP_SIZE - 1) / GROUP_SIZE;
+
+                std::uint64_t freq[MAX_SYMBOLS];
+                std::memset(freq, 0, sizeof(freq));
+                for (std::size_t i = 0; i < n; i++)
+                    freq[in[i]]++;
+
+                initialLengths(freq, n, symbols, tables, len);
+
+                selector.assign(groups, 0);
+                std::uint64_t packed[MAX_SYMBOLS];
+                for (unsigned iter = 0; iter < ITERATIONS; iter++) {
+                    // the lengths of a symbol in all tables side by side, so one
+                    // addition per symbol prices a group under every table
+                    for (unsigned v = 0; v < symbols; v++) {
+                        packed[v] = 0;
+                        for (unsigned t = 0; t < tables; t++)
+                            packed[v] |= std::uint64_t(len[t][v]) << (COST_BITS * t);
+                    }
+
+                    std::memset(tableFreq, 0, MAX_TABLES * sizeof(tableFreq[0]));
+                    for (std::size_t g = 0; g < groups; g++) {
+                        const std::size_t begin = g * GROUP_SIZE;
+                        const std::size_t end = std::min(n, begin + GROUP_SIZE);
+
+                        std::uint64_t cost = 0;
+                        for (std::size_t i = begin; i < end; i++)
+                            cost += packed[in[i]];
+                        const unsigned mask = (1u << COST_BITS) - 1;
+                        unsigned best = 0;
+                        for (unsigned t = 1; t < tables; t++)
+                            if (((cost >> (COST_BITS * t)) & mask) < ((cost >> (COST_BITS * best)) & mask))
+                                best = t;
+
+                        selector[g] = best;
+                        for (std::size_t i = begin; i < end; i++)
+                            tableFreq[best][in[i]]++;
+                    }
+
+                    // every symbol of the block keeps a code in every table
+                    for (unsigned t = 0; t < tables; t++) {
+                        std::uint64_t weight[MAX_SYMBOLS];
+                        for (unsigned v = 0; v < symbols; v++)
+                            weight[v] = tableFreq[t][v] ? tableFreq[t][v] << 8 : freq[v] != 0;
+                        buildLengths(weight, len[t], symbols);
+                    }
                 }
+                return tables;
             }
 
-            /**
-             * Reads a sequence of bits that represents a Huffman-compressed message from
-             * standard input; expands them; and writes the results to standard output.
-             **/
-        public:
-                            void static expand(istreambin &streamin, ostreambin &streamout) {
+            // selectors, move-to-front coded over the tables and written in unary
+            void static writeSelectors(const std::vector<unsigned char> &selector, unsigned tables, BitWriter &out) {
+                unsigned char order[MAX_TABLES];
+                for (unsigned t = 0; t < tables; t++)
+                    order[t] = t;
+                for (std::size_t g = 0; g < selector.size(); g++) {
+                    unsigned j = 0;
+                    while (order[j] != selector[g])
+                        j++;
+                    std::memmove(order + 1, order, j);
+                    order[0] = selector[g];
+                    out.writeBits((1u << (j + 1)) - 2, j + 1);
+                }
+            }
+
+            void static readSelectors(BitReader &in, std::vector<unsigned char> &selector, unsigned tables) {
+                unsigned char order[MAX_TABLES];
+                for (unsigned t = 0; t < tables; t++)
+                    order[t] = t;
+                for (std::size_t g = 0; g < selector.size(); g++) {
+                    unsigned j = 0;
+                    while (in.readBit())
+                        if (++j >= tables)
+                            throw std::runtime_error("Corrupted Huffman selectors");
+                    const unsigned char t = order[j];
+                    std::memmove(order + 1, order, j);
+                    order[0] = t;
+                    selector[g] = t;
+                    if (in.overrun())
+                        throw std::runtime_error("Truncated Huffman selectors");
+                }
+            }
+
+        private:
+            // width of one table's cost of a group in the packed costs
+            static const unsigned COST_BITS = 10;
+            static_assert(GROUP_SIZE * MAX_CODE_LENGTH < (1u << COST_BITS) && COST_BITS * MAX_TABLES <= 64,
+                    "packed group costs overflow");
+
+            // more tables pay off as the message grows
+            unsigned static tableCount(std::size_t n) {
+                if (n < 200)
+                    return 1;
+                if (n < 600)
+                    return 3;
+                if (n < 1200)
+                    return 4;
+                if (n < 2400)
+                    return 5;
+                return MAX_TABLES;
+            }
+
+            // starting point of the refinement: table t covers a run of the
+            // alphabet holding about 1/tables of the symbols, cheap inside the
+            // run and expensive outside
+            void static initialLengths(const std::uint64_t *freq, std::size_t n, unsigned symbols,
+                    unsigned tables, unsigned (*len)[MAX_SYMBOLS]) {
+                std::uint64_t remaining = n;
+                unsigned begin = 0;
+                for (unsigned part = tables; part > 0; part--) {
+                    const std::uint64_t target = remaining / part;
+                    std::uint64_t sum = 0;
+                    unsigned end = begin;
+                    while (end < symbols && (sum < target || part == 1))
+                        sum += freq[end++];
+
+                    // alternate rounding so tables do not all lean the same way
+                    if (end > begin + 1 && part != tables && part != 1 && (tables - part) % 2 == 1)
+                        sum -= freq[--end];
+
+                    for (unsigned v = 0; v < symbols; v++)
+                        len[part - 1][v] = v >= begin && v < end ? 0 : MAX_CODE_LENGTH;
+                    remaining -= sum;
+                    begin = end;
+                }
+            }
 
-                                streamin.fillbuffer();
+            // number of tables, selectors and code lengths of a multi-table
+            // message of length symbols; one decoder per table
+            void static readTables(BitReader &in, std::size_t length, unsigned symbols,
+                    std::vector<unsigned char> &selector, std::vector<HuffmanDecoder> &decoders) {
+                const unsigned tables = in.readBits(3);
+                if (tables == 0 || tables > MAX_TABLES)
+                    throw std::runtime_error("Corrupted Huffman table count");
+
+                selector.resize((length + GROUP_SIZE - 1) / GROUP_SIZE);
+                readSelectors(in, selector, tables);
+
+                for (unsigned t = 0; t < tables; t++) {
+                    unsigned len[MAX_SYMBOLS];
+                    std::uint32_t code[MAX_SYMBOLS];
+                    std::uint64_t code64[MAX_SYMBOLS];
+                    readLengths(in, len, symbols);
+                    buildCode(len, code, symbols);
+                    for (unsigned i = 0; i < symbols; i++)
+                        code64[i] = code[i];
+                    decoders.push_back(HuffmanDecoder(code64, len, symbols));
+                }
+                if (in.overrun())
+                    throw std::runtime_error("Truncated Huffman header");
+            }
 
-                                // read in Huffman trie from input stream
-                                Node_ptr root(readTrie(streamin));
+            // Decode the groups of the S streams data[s][0..size[s]) into out;
+            // false if a stream ran short. The groups are decoded a group of
+            // every stream at a time: all streams side by side while each has
+            // a whole group and enough input left, then stream by stream.
+            template <unsigned S, typename T>
+            bool static decodeStreams(const unsigned char *const *data, const std::uint32_t *size,
+                    const std::vector<HuffmanDecoder> &decoders, const std::vector<unsigned char> &selector,
+                    std::size_t length, T *__restrict out) {
+                const std::size_t groups = selector.size();
+                const std::size_t perStream = (groups + S - 1) / S;
+
+                BitCursor in[S];
+                for (unsigned s = 0; s < S; s++)
+                    in[s] = BitCursor(data[s], size[s]);
+
+                // the last stream holds the fewest groups, and the last group may be short
+                const std::size_t whole = length / GROUP_SIZE;
+                const std::size_t sideBySide = whole > (S - 1) * perStream ? whole - (S - 1) * perStream : 0;
+                std::size_t g = decodeSideBySide<S>(in, decoders, selector, perStream, std::min(sideBySide, perStream), out);
+
+                for (; g < perStream; g++)
+                    for (unsigned s = 0; s < S; s++) {
+                        const std::size_t group = s * perStream + g;
+                        if (group < groups) {
+                            const std::size_t begin = group * GROUP_SIZE;
+                            decoders[selector[group]].decode(in[s], out + begin,
+                                    std::min<std::size_t>(GROUP_SIZE, length - begin));
+                        }
+                    }
+                for (unsigned s = 0; s < S; s++)
+                    if (in[s].overrun())
+                        return false;
+                return true;
+            }
 
-                                // number of bytes to write
-                                int length;
+            // Decode group g of every stream, one symbol of each in turn, from
+            // g = 0 up to end or until a stream is too close to its end to
+            // refill without checks; returns the next group. The cursors are
+            // copied in and out so that, with the loops over the S streams
+            // unrolled (left to itself the compiler keeps the loop and the
+            // cursors in memory), they stay in registers.
+            template <unsigned S, typename T>
+            std::size_t static decodeSideBySide(BitCursor *in, const std::vector<HuffmanDecoder> &decoders,
+                    const std::vector<unsigned char> &selector, std::size_t perStream, std::size_t end,
+                    T *__restrict out) {
+                // bytes one group may take, plus the width of a refill
+                const std::size_t reserve = GROUP_SIZE * MAX_CODE_LENGTH / 8 + 8;
+                unsigned maxLen = 1;
+                for (std::size_t t = 0; t < decoders.size(); t++)
+                    maxLen = std::max(maxLen, decoders[t].maxLength());
+                const unsigned perRefill = BitReader::MIN_BITS / maxLen;
+
+                BitCursor c[S];
+                for (unsigned s = 0; s < S; s++)
+                    c[s] = in[s];
+                std::size_t g = 0;
+                for (; g < end; g++) {
+                    bool room = true;
+                    for (unsigned s = 0; s < S; s++)
+                        room &= c[s].ahead(reserve);
+                    if (!room)
+                        break;
+
+                    const HuffmanDecoder *decoder[S];
+                    T *to[S];
+                    for (unsigned s = 0; s < S; s++) {
+                        decoder[s] = &decoders[selector[s * perStream + g]];
+                        to[s] = out + (s * perStream + g) * GROUP_SIZE;
+                    }
+                    for (unsigned i = 0; i < GROUP_SIZE; ) {
+#pragma GCC unroll 8
+                        for (unsigned s = 0; s < S; s++)
+                            c[s].refillAhead();
+                        const unsigned stop = std::min(GROUP_SIZE, i + perRefill);
+                        for (; i < stop; i++)
+#pragma GCC unroll 8
+                            for (unsigned s = 0; s < S; s++)
+                                to[s][i] = decoder[s]->symbol(c[s]);
+                    }
+                }
+                for (unsigned s = 0; s < S; s++)
+                    in[s] = c[s];
+                return g;
+            }
 
-                                streamin.read(reinterpret_cast<char *>(&length), sizeof(length));
+            // message lengths take 64 bits, in two halves as writeBits() is narrower
+            void static writeLength(std::uint64_t n, BitWriter &out) {
+                out.writeBits(n >> 32, 32);
+                out.writeBits(n & 0xffffffff, 32);
+            }
 
-                                std::stringstream ss;
+            std::uint64_t static readLength(BitReader &in) {
+                const std::uint64_t high = in.readBits(32);
+                return high << 32 | in.readBits(32);
+            }
 
-                                // decode using the Huffman trie
-                                for (int i = 0; i < length; i++) {
-                                    Node *x = root.get();
-                                    while (!x->isLeaf()) {
-                                        bool bit;
-                                        streamin.read(bit);
-                                        x = (bit ? x->right: x->left).get();
-                                    }
-                                    //streamout.getStream()->put(x->ch);
-                                    ss.put(x->ch);
-                                }
-                                (*streamout.getStream()) << ss.rdbuf();
-                                streamout.flush();
-                            }
+            // number of symbols and code lengths; returns the decoder of the code
+            HuffmanDecoder static readHeader(BitReader &in, unsigned symbols, std::size_t &length) {
+                if (symbols > MAX_SYMBOLS)
+                    throw std::invalid_argument("Huffman alphabet too large");
+
+                // number of symbols to write
+                length = readLength(in);
+
+                // read in the code lengths
+                unsigned len[MAX_SYMBOLS];
+                readLengths(in, len, symbols);
+                if (in.overrun())
+                    throw std::runtime_error("Truncated Huffman header");
+
+                std::uint32_t code[MAX_SYMBOLS];
+                std::uint64_t code64[MAX_SYMBOLS];
+                buildCode(len, code, symbols);
+                for (unsigned i = 0; i < symbols; i++)
+                    code64[i] = code[i];
+                return HuffmanDecoder(code64, len, symbols);
+            }
 
-        private:
-                            static Node *readTrie(istreambin &streamin) {
-                                bool isLeaf;
-
-                                streamin.read(isLeaf);
-                                Node_ptr ret;
-
-                                if (isLeaf) {
-                                    char c;
-                                    streamin.read(c);
-                                    ret.reset(new Node(c, -1));
-                                }
-                                else {
-                                    Node_ptr left(readTrie(streamin));
-                                    Node_ptr right(readTrie(streamin));
-                                    ret.reset(new Node('\0', -1, left, right));
-                                }
-
-                                return ret.release();
-                            }
+            // Moffat & Katajainen: a[0..n) sorted by ascending weight is replaced
+            // by the optimal code lengths, in place
+            void static minimumRedundancy(std::uint64_t *a, unsigned n) {
+                unsigned root, leaf, next;
+
+                // first pass, left to right, setting parent pointers
+                a[0] += a[1]; root = 0; leaf = 2;
+                for (next = 1; next < n - 1; next++) {
+                    // select first item for a pairing
+                    if (leaf >= n || a[root] < a[leaf]) {
+                        a[next] = a[root]; a[root++] = next;
+                    }
+                    else
+                        a[next] = a[leaf++];
+
+                    // add on the second item
+                    if (leaf >= n || (root < next && a[root] < a[leaf])) {
+                        a[next] += a[root]; a[root++] = next;
+                    }
+                    else
+                        a[next] += a[leaf++];
+                }
+
+                // second pass, right to left, setting internal depths
+                a[n - 2] = 0;
+                for (int i = int(n) - 3; i >= 0; i--)
+                    a[i] = a[a[i]] + 1;
+
+                // third pass, right to left, setting leaf depths
+                int avbl = 1, used = 0, dpth = 0, r = n - 2, nx = n - 1;
+                while (avbl > 0) {
+                    while (r >= 0 && a[r] == std::uint64_t(dpth)) {
+                        used++; r--;
+                    }
+                    while (avbl > used) {
+                        a[nx--] = dpth; avbl--;
+                    }
+                    avbl = 2 * used; dpth++; used = 0;
+                }
+            }
+
+            // code lengths: a bitmap of the used groups of 16 symbols, then
+            // a 4-bit length for every symbol of those groups
+            void static writeLengths(const unsigned *len, unsigned symbols, BitWriter &out) {
+                const unsigned groups = (symbols + 15) / 16;
+                std::uint32_t used = 0;
+                for (unsigned g = 0; g < groups; g++)
+                    for (unsigned i = 16 * g; i < 16 * g + 16 && i < symbols; i++)
+                        if (len[i])
+                            used |= 1u << g;
+
+                out.writeBits(used, groups);
+                for (unsigned g = 0; g < groups; g++)
+                    if (used & (1u << g))
+                        for (unsigned i = 16 * g; i < 16 * g + 16; i++)
+                            out.writeBits(i < symbols ? len[i] : 0, 4);
+            }
+
+            void static readLengths(BitReader &in, unsigned *len, unsigned symbols) {
+                const unsigned groups = (symbols + 15) / 16;
+                const std::uint32_t used = in.readBits(groups);
+
+                std::uint32_t kraft = 0;
+                for (unsigned g = 0; g < groups; g++)
+                    for (unsigned i = 16 * g; i < 16 * g + 16; i++) {
+                        const unsigned l = (used & (1u << g)) ? in.readBits(4) : 0;
+                        if (i < symbols)
+                            len[i] = l;
+                        else if (l)
+                            throw std::runtime_error("Corrupted Huffman code lengths");
+                        if (l)
+                            kraft += 1u << (MAX_CODE_LENGTH - l);
+                    }
+                // the lengths must describe a prefix code
+                if (kraft > (1u << MAX_CODE_LENGTH))
+                    throw std::runtime_error("Corrupted Huffman code lengths");
+            }
     };
 }
 #endif
@@ -0,0 +1,146 @@
+#ifndef _HUFFMANDECODER_H_
+#define _HUFFMANDECODER_H_
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "BitReader.h"
+
+namespace bw {
+    // Table driven Huffman decoder. The root table resolves the first ROOT_BITS
+    // bits of a codeword in one lookup; longer codes continue in sub-tables
+    // of up to SUB_BITS bits, chained as deep as the code requires.
+    class HuffmanDecoder {
+        public:
+            static const unsigned ROOT_BITS = 11;
+            static const unsigned SUB_BITS = 8;
+            // longest code the bit reader can resolve after one refill
+            static const unsigned MAX_CODE_LENGTH = BitReader::MIN_BITS;
+
+        private:
+            // leaf entry: LEAF | bits << 16 | symbol
+            // link entry: bits << 24 | offset of the sub-table (bits > 0)
+            static const std::uint32_t LEAF = 0x80000000u;
+
+            struct Code {
+                unsigned symbol;
+                std::uint64_t code;
+                unsigned len;
+            };
+
+            std::vector<std::uint32_t> table;
+            unsigned rootBits;
+            unsigned maxLen;
+
+        public:
+            // code[s]/len[s] is the codeword of symbol s (len[s] == 0 if unused),
+            // most significant bit first
+            HuffmanDecoder(const std::uint64_t *code, const unsigned *len, unsigned symbols)
+                :rootBits(0)
+                ,maxLen(1)
+            {
+                std::vector<Code> codes;
+                for (unsigned s = 0; s < symbols; s++) {
+                    if (len[s] == 0)
+                        continue;
+                    if (len[s] > MAX_CODE_LENGTH)
+                        throw std::invalid_argument("Huffman code too long");
+                    Code c = { s, code[s], len[s] };
+                    codes.push_back(c);
+                    if (len[s] > maxLen)
+                        maxLen = len[s];
+                }
+                rootBits = maxLen;
+                if (rootBits > ROOT_BITS)
+                    rootBits = ROOT_BITS;
+                build(codes, 0, rootBits);
+            }
+
+            // longest codeword of the code
+            unsigned maxLength() const
+            {
+                return maxLen;
+            }
+
+            // decode count symbols from a BitReader or BitCursor
+            template <typename Bits, typename T>
+            void decode(Bits &in, T *__restrict out, std::size_t count) const
+            {
+                // every refill leaves room for this many codewords
+                const std::size_t perRefill = BitReader::MIN_BITS / maxLen;
+
+                for (std::size_t i = 0; i < count; ) {
+                    in.refill();
+                    const std::size_t stop = count - i < perRefill ? count : i + perRefill;
+                    for (; i < stop; i++)
+                        out[i] = symbol(in);
+                }
+                if (in.overrun())
+                    throw std::runtime_error("Truncated Huffman stream");
+            }
+
+            // decode one codeword from a BitReader or BitCursor holding
+            // maxLength() bits
+            template <typename Bits>
+            unsigned symbol(Bits &in) const
+            {
+                const std::uint32_t *t = table.data();
+                unsigned k = rootBits;
+                std::uint32_t e = t[in.peekBits(k)];
+                while (!(e & LEAF)) {
+                    const unsigned sub = e >> 24;
+                    if (sub == 0)
+                        throw std::runtime_error("Invalid Huffman code");
+                    in.consume(k);
+                    k = sub;
+                    e = t[(e & 0xffffff) + in.peekBits(k)];
+                }
+                in.consume((e >> 16) & 0x7f);
+                return e & 0xffff;
+            }
+
+        private:
+            // lay out a table of 2^k entries for codes whose first c bits are already consumed
+            unsigned build(const std::vector<Code> &codes, unsigned c, unsigned k)
+            {
+                const unsigned offset = table.size();
+                table.resize(offset + (1u << k), 0);
+
+                // codes longer than c + k, grouped by their k-bit prefix at this level
+                std::vector<std::vector<Code>> longer;
+                for (unsigned i = 0; i < codes.size(); i++) {
+                    const Code &x = codes[i];
+                    const unsigned rem = x.len - c;
+                    const std::uint64_t bitsHere = x.code & ((std::uint64_t(1) << rem) - 1);
+                    if (rem <= k) {
+                        const std::uint32_t first = std::uint32_t(bitsHere) << (k - rem);
+                        const std::uint32_t e = LEAF | (rem << 16) | x.symbol;
+                        for (std::uint32_t j = 0; j < (1u << (k - rem)); j++)
+                            table[offset + first + j] = e;
+                    }
+                    else {
+                        const unsigned prefix = bitsHere >> (rem - k);
+                        if (longer.empty())
+                            longer.resize(1u << k);
+                        longer[prefix].push_back(x);
+                    }
+                }
+
+                for (unsigned prefix = 0; prefix < longer.size(); prefix++) {
+                    if (longer[prefix].empty())
+                        continue;
+                    unsigned maxRem = 0;
+                    for (unsigned i = 0; i < longer[prefix].size(); i++)
+                        if (longer[prefix][i].len - c - k > maxRem)
+                            maxRem = longer[prefix][i].len - c - k;
+                    const unsigned sub = maxRem < SUB_BITS ? maxRem : SUB_BITS;
+                    const unsigned at = build(longer[prefix], c + k, sub);
+                    table[offset + prefix] = (sub << 24) | at;
+                }
+                return offset;
+            }
+    };
+}
+#endif
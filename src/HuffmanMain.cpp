@@ -1,14 +1,17 @@
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <sstream>
 #include <string>
 #include <fstream>
+#include <chrono>
 #include <getopt.h>
 
 #include "shared.h"
 #include "Huffman.h"
 #include "istreambin.h"
 #include "ostreambin.h"
+#include "Stats.h"
 
 namespace
 {
@@ -23,7 +26,8 @@ void usage() {
                          "-o/--output: Set input file\n"
                          "-e/--encode: Encode\n"
                          "-d/--decode: Decode\n"
-                         "-x/--hexdump: Emit in hex format\n");
+                         "-x/--hexdump: Emit in hex format\n"
+                         "--stats[=json]: Print per-stage statistics to standard error\n");
 }
 
 
@@ -34,6 +38,7 @@ int main(int argc, char** argv)
     std::string appName = basename(argv[0]);
     int option_index, c;
     bool use_hex(false), encode(false), decode(false);
+    bool stats(false), stats_json(false);
     static struct option long_options[] =
         {
           /* These options don’t set a flag.
@@ -44,6 +49,7 @@ int main(int argc, char** argv)
           {"hexdump",   no_argument,     0, 'x'},
           {"output",   required_argument,     0, 'o'},
           {"input",   required_argument,     0, 'i'},
+          {"stats",    optional_argument, 0, 'S'},
           {0, 0, 0, 0}
         };
     while((c = getopt_long(argc, argv, "i:o:hexd", long_options, &option_index)) >= 0) {
@@ -53,6 +59,13 @@ int main(int argc, char** argv)
             case 'i': sif     = optarg; break;
             case 'o': sof     = optarg; break;
             case 'x': use_hex = true; break;
+            case 'S':
+                stats = true;
+                if (!bw::parseStatsFormat(optarg, stats_json)) {
+                    std::fprintf(stderr, "Invalid statistics format '%s': expected text or json\n", optarg);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
             case 'h':
                 std::cout << "Huffman command line tool" << std::endl <<
                     "Usage: " << basename(argv[0]) << " [-h+-] [-x]" << std::endl;
@@ -70,6 +83,7 @@ int main(int argc, char** argv)
 
     bw::istreambin streamin(ifs.is_open() ? &ifs : &std::cin);
     bw::ostreambin streamout(ofs.is_open() ? &ofs : &std::cout);
+    const auto start = std::chrono::steady_clock::now();
 
     if (encode)
     {
@@ -78,7 +92,7 @@ int main(int argc, char** argv)
             std::stringstream sout;
             bw::ostreambin streamout_ex(&sout);
             bw::Huffman::compress(streamin, streamout_ex);
-            int bytes = 0;
+            std::uint64_t bytes = 0;
             char c;
             while (sout.get(c))
             {
@@ -100,6 +114,11 @@ int main(int argc, char** argv)
         bw::Huffman::expand(streamin, streamout);
     }
 
+    if (stats) {
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        bw::Stats::report(stderr, stats_json, elapsed.count());
+    }
+
     return SUCCESS;
 
 } // main
@@ -0,0 +1,70 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+bw::MappedFile::MappedFile(const std::string &path)
+    :fd(::open(path.c_str(), O_RDONLY))
+    ,base(nullptr)
+    ,length(0)
+    ,isMapped(false)
+{
+    if (fd < 0)
+        throw std::runtime_error("Cannot open " + path);
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        return;
+
+    length = st.st_size;
+    isMapped = true;
+    if (length == 0)
+        return;
+
+    void *p = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        length = 0;
+        isMapped = false;
+        return;
+    }
+    base = static_cast<const char *>(p);
+    ::madvise(p, length, MADV_SEQUENTIAL);
+}
+
+bw::MappedFile::~MappedFile()
+{
+    if (base != nullptr)
+        ::munmap(const_cast<char *>(base), length);
+    ::close(fd);
+}
+
+void bw::MappedFile::load(std::uint64_t offset, std::size_t n) const
+{
+    if (base == nullptr || offset >= length)
+        return;
+    n = std::min<std::uint64_t>(n, length - offset);
+    const std::uint64_t page = ::sysconf(_SC_PAGESIZE);
+    const std::uint64_t begin = offset / page * page;
+    ::madvise(const_cast<char *>(base) + begin, offset + n - begin, MADV_WILLNEED);
+    // reading a byte of every page waits for it, here rather than in the reader of the range
+    unsigned char sum = 0;
+    for (std::uint64_t i = offset; i < offset + n; i += page - i % page)
+        sum += static_cast<const volatile char *>(base)[i];
+    (void) sum;
+}
+
+void bw::MappedFile::release(std::uint64_t offset, std::size_t n) const
+{
+    if (base == nullptr)
+        return;
+    // only whole pages inside the range
+    const std::uint64_t page = ::sysconf(_SC_PAGESIZE);
+    const std::uint64_t begin = (offset + page - 1) / page * page;
+    const std::uint64_t end = (offset + n) / page * page;
+    if (begin < end)
+        ::madvise(const_cast<char *>(base) + begin, end - begin, MADV_DONTNEED);
+}
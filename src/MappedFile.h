@@ -0,0 +1,40 @@
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <string>
+#include <cstdint>
+
+namespace bw
+{
+    // Read-only memory mapping of a whole file. Files that cannot be mapped
+    // (pipes, terminals) are left unmapped so callers can fall back to
+    // reading them as streams.
+    class MappedFile {
+        private:
+            int fd;
+            const char *base;
+            std::size_t length;
+            bool isMapped;
+
+        public:
+            MappedFile(const MappedFile &that)=delete;
+            MappedFile &operator=(const MappedFile &that)=delete;
+
+            // throws if the file cannot be opened
+            explicit MappedFile(const std::string &path);
+            ~MappedFile();
+
+            bool mapped() const { return isMapped; }
+            const char *data() const { return base; }
+            std::size_t size() const { return length; }
+            // descriptor of the open file, mapped or not
+            int descriptor() const { return fd; }
+
+            // fault in the pages of [offset, offset + n) ahead of their use
+            void load(std::uint64_t offset, std::size_t n) const;
+            // drop the pages of [offset, offset + n) once they are no longer needed
+            void release(std::uint64_t offset, std::size_t n) const;
+    };
+}
+
+#endif
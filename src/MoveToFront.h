@@ -2,82 +2,143 @@
 #define _MOVETOFRONT_H_
 
 #include <string>
-#include <vector>
 #include <iostream>
-#include <sstream>
-#include <memory>
+#include <cstring>
+
+#include "Stats.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace bw
 {
+    // Move-to-front over a flat 256-byte recency table. Searching and shifting
+    // the table use SSE2 16 bytes at a time, with a scalar fallback on other
+    // targets.
     class MoveToFront {
-        // apply move-to-front encoding, reading from standard input and writing to standard output
         private:
-            class Item
+            // Do not instantiate.
+            MoveToFront()
             {
-                private:
-                    unsigned char value;
-                public:
-                    Item(char v) {
-                        value = v;
-                    }
-                    unsigned char get() const { return value; }
-                    void set(const char &c) { value = c; }
-                    void inc() { value++; }
-            };
+            }
 
         public:
+            // apply move-to-front encoding, reading from standard input and writing to standard output
             void static encode(std::istream &streamin, std::ostream &streamout)
             {
-                std::vector<std::shared_ptr<Item>> ct(256);
-                std::vector<std::shared_ptr<Item>> cv(256);
+                std::string in(std::istreambuf_iterator<char>(streamin), {});
+                std::string out(in.size(), '\0');
 
-                std::stringstream sb;
-
-                for (int i = 0; i < 256; i++) {
-                    ct[i] = std::shared_ptr<Item>(new Item(i));
-                    cv[i] = ct[i];
-                }
-
-                char c;
-                while (streamin.get(c)) {
-                    unsigned char d = c;
-                    std::shared_ptr<Item> pos = ct[d];
-                    for (int i = pos->get(); i > 0; --i) {
-                        cv[i] = cv[i-1];
-                        cv[i]->inc();
-                    }
-                    cv[0] = pos;
-                    sb.put((char)pos->get());
-                    pos->set(0);
-                }
+                encode(reinterpret_cast<const unsigned char *>(in.data()), in.size(),
+                        reinterpret_cast<unsigned char *>(&out[0]));
 
-                streamout << sb.rdbuf();
+                streamout.write(out.data(), out.size());
                 streamout.flush();
             }
 
             // apply move-to-front decoding, reading from standard input and writing to standard output
             void static decode(std::istream &streamin, std::ostream &streamout)
             {
-                char c, p;
-                std::vector<char> cv(256);
-                std::stringstream sb;
+                std::string in(std::istreambuf_iterator<char>(streamin), {});
+                std::string out(in.size(), '\0');
 
-                for (int i = 0; i < 256; i++) {
-                    cv[i] = i;
-                }
+                decode(reinterpret_cast<const unsigned char *>(in.data()), in.size(),
+                        reinterpret_cast<unsigned char *>(&out[0]));
 
-                while (streamin.get(p)) {
-                    unsigned char d = p;
-                    c = cv[d];
-                    sb.put(c);
+                streamout.write(out.data(), out.size());
+                streamout.flush();
+            }
 
-                    for (int i = d; i > 0; i--) {
-                        cv[i] = cv[i-1];
+            // encode in[0..n) into out[0..n)
+            void static encode(const unsigned char *in, std::size_t n, unsigned char *out)
+            {
+                BW_STATS_TIMER(timer, MTF_ENCODE, n);
+                BW_STATS_OUTPUT(timer, n);
+                alignas(16) unsigned char table[256];
+                init(table);
+
+                for (std::size_t i = 0; i < n; i++) {
+                    const unsigned char c = in[i];
+                    if (table[0] == c) {
+                        out[i] = 0;
+                        continue;
                     }
-                    cv[0] = c;
+                    const unsigned pos = find(table, c);
+                    out[i] = pos;
+                    moveToFront(table, pos);
                 }
-                streamout << sb.rdbuf();
-                streamout.flush();
+            }
+
+            // decode in[0..n) into out[0..n)
+            void static decode(const unsigned char *in, std::size_t n, unsigned char *out)
+            {
+                BW_STATS_TIMER(timer, MTF_DECODE, n);
+                BW_STATS_OUTPUT(timer, n);
+                alignas(16) unsigned char table[256];
+                init(table);
+
+                for (std::size_t i = 0; i < n; i++) {
+                    const unsigned pos = in[i];
+                    out[i] = table[pos];
+                    if (pos)
+                        moveToFront(table, pos);
+                }
+            }
+
+        private:
+            void static init(unsigned char *table)
+            {
+                for (int i = 0; i < 256; i++)
+                    table[i] = i;
+            }
+
+            // position of c in the table
+            unsigned static find(const unsigned char *table, unsigned char c)
+            {
+#if defined(__SSE2__)
+                const __m128i key = _mm_set1_epi8(c);
+                for (unsigned i = 0; i < 256; i += 16) {
+                    const __m128i v = _mm_load_si128(reinterpret_cast<const __m128i *>(table + i));
+                    const unsigned m = _mm_movemask_epi8(_mm_cmpeq_epi8(v, key));
+                    if (m)
+                        return i + __builtin_ctz(m);
+                }
+#else
+                for (unsigned i = 0; i < 256; i++)
+                    if (table[i] == c)
+                        return i;
+#endif
+                return 0;
+            }
+
+            // move table[pos] to the front, shifting table[0..pos) up by one
+            void static moveToFront(unsigned char *table, unsigned pos)
+            {
+#if defined(__SSE2__)
+                // each 16-byte chunk up to the one holding pos is shifted by one byte,
+                // carrying the last byte of the previous chunk (or table[pos]) in front
+                const unsigned last = pos >> 4;
+                __m128i carry = _mm_cvtsi32_si128(table[pos]);
+                for (unsigned k = 0; k < last; k++) {
+                    __m128i *p = reinterpret_cast<__m128i *>(table) + k;
+                    const __m128i v = _mm_load_si128(p);
+                    _mm_store_si128(p, _mm_or_si128(_mm_slli_si128(v, 1), carry));
+                    carry = _mm_srli_si128(v, 15);
+                }
+
+                // in the last chunk only the lanes up to pos change
+                const __m128i lanes = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+                const __m128i mask = _mm_cmplt_epi8(lanes, _mm_set1_epi8((pos & 15) + 1));
+                __m128i *p = reinterpret_cast<__m128i *>(table) + last;
+                const __m128i v = _mm_load_si128(p);
+                const __m128i shifted = _mm_or_si128(_mm_slli_si128(v, 1), carry);
+                _mm_store_si128(p, _mm_or_si128(_mm_and_si128(mask, shifted), _mm_andnot_si128(mask, v)));
+#else
+                const unsigned char c = table[pos];
+                std::memmove(table + 1, table, pos);
+                table[0] = c;
+#endif
             }
     };
 }
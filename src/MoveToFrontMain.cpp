@@ -1,10 +1,13 @@
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <sstream>
+#include <chrono>
 
 #include "shared.h"
 
 #include "MoveToFront.h"
+#include "Stats.h"
 #include <getopt.h>
 
 namespace
@@ -19,13 +22,15 @@ void usage() {
     std::fprintf(stderr, "-h/--help: Emit help menu\n"
                          "-e/--encode: Encode\n"
                          "-d/--decode: Decode\n"
-                         "-x/--hexdump: Emit in hex format\n");
+                         "-x/--hexdump: Emit in hex format\n"
+                         "--stats[=json]: Print per-stage statistics to standard error\n");
 }
 
 int main(int argc, char** argv)
 {
     int c, option_index;
     bool encode(false), decode(false), use_hex(false);
+    bool stats(false), stats_json(false);
     static struct option long_options[] =
         {
           /* These options don’t set a flag.
@@ -34,6 +39,7 @@ int main(int argc, char** argv)
           {"encode",   no_argument,      0, 'e'},
           {"decode",   no_argument,      0, 'd'},
           {"hexdump",   no_argument,     0, 'x'},
+          {"stats",    optional_argument, 0, 'S'},
           {0, 0, 0, 0}
         };
     while((c = getopt_long(argc, argv, "hexd", long_options, &option_index)) >= 0) {
@@ -41,6 +47,13 @@ int main(int argc, char** argv)
             case 'e': encode  = true; break;
             case 'd': decode  = true; break;
             case 'x': use_hex = true; break;
+            case 'S':
+                stats = true;
+                if (!bw::parseStatsFormat(optarg, stats_json)) {
+                    std::fprintf(stderr, "Invalid statistics format '%s': expected text or json\n", optarg);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
             case 'h':
                 std::cout << "Move to front command line tool" << std::endl <<
                     "Usage: " << basename(argv[0]) << " [-h+-] [-x]" << std::endl;
@@ -50,6 +63,7 @@ int main(int argc, char** argv)
     }
 
     std::string appName = basename(argv[0]);
+    const auto start = std::chrono::steady_clock::now();
     /** Define and parse the program options
      *      */
 
@@ -59,7 +73,7 @@ int main(int argc, char** argv)
         {
             std::stringstream sout;
             bw::MoveToFront::encode(std::cin, sout);
-            int bytes = 0;
+            std::uint64_t bytes = 0;
             char c;
             while (sout.get(c))
             {
@@ -81,6 +95,11 @@ int main(int argc, char** argv)
         bw::MoveToFront::decode(std::cin, std::cout);
     }
 
+    if (stats) {
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        bw::Stats::report(stderr, stats_json, elapsed.count());
+    }
+
     return SUCCESS;
 
 } // main
@@ -0,0 +1,400 @@
+#include "ParallelSuffixSort.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <cstring>
+
+const unsigned bw::ParallelSuffixSort::DEPTH;
+const std::size_t bw::ParallelSuffixSort::SPLIT;
+const std::size_t bw::ParallelSuffixSort::SMALL;
+const unsigned bw::ParallelSuffixSort::REPEATS;
+
+namespace
+{
+    typedef bw::ParallelSuffixSort::Group Group;
+
+    const unsigned BUCKETS = 1 << 16;
+
+    // run f(t) for t in [0, threads), the caller taking t = 0; the first
+    // exception thrown by any of them is rethrown once all have finished
+    template <typename F>
+    void parallel(unsigned threads, F f)
+    {
+        std::exception_ptr error;
+        std::mutex mutex;
+        auto guarded = [&](unsigned t) {
+            try {
+                f(t);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+        };
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < threads; t++)
+            workers.emplace_back(guarded, t);
+        guarded(0);
+        for (std::thread &w : workers)
+            w.join();
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    // rows [lo, hi) whose first depth bytes are sorted and equal
+    struct Range {
+        std::uint32_t lo, hi, depth;
+    };
+
+    class Sorter {
+        private:
+            struct Worker {
+                std::mutex mutex;
+                std::deque<Range> ranges;
+                std::vector<Group> done;    // groups equal up to limit
+            };
+
+            const unsigned char *d;         // the string twice over and a word more
+            std::uint32_t n;
+            std::uint32_t *sa;
+            unsigned threads;
+            std::uint32_t limit;            // bytes radix quicksort compares
+            std::uint64_t most;             // rows that may be left equal after limit
+            std::unique_ptr<Worker[]> workers;
+            std::atomic<std::size_t> pending;     // ranges queued or being sorted
+            std::atomic<std::size_t> queued;      // ranges in the deques
+            std::atomic<std::uint64_t> left;
+            std::mutex idle;                        // threads out of ranges wait on changed
+            std::condition_variable changed;
+
+        public:
+            Sorter(const unsigned char *_d, std::uint32_t _n, std::uint32_t *_sa, unsigned _threads, std::uint64_t _most)
+                :d(_d), n(_n), sa(_sa), threads(_threads)
+                ,limit(std::min<std::uint32_t>(bw::ParallelSuffixSort::DEPTH, _n)), most(_most)
+                ,workers(new Worker[_threads]), pending(0), queued(0), left(0)
+            {
+            }
+
+            // rows still equal after limit bytes, in groups; false, as soon
+            // as it is known, when there are more than most of them
+            bool sort(std::vector<Group> &groups)
+            {
+                radix();
+                parallel(threads, [this](unsigned t) { work(t); });
+                if (left > most)
+                    return false;
+                groups.clear();
+                for (unsigned t = 0; t < threads; t++)
+                    groups.insert(groups.end(), workers[t].done.begin(), workers[t].done.end());
+                return true;
+            }
+
+        private:
+            unsigned key(std::uint32_t i) const
+            {
+                return unsigned(d[i]) << 8 | d[i + 1];
+            }
+
+            // counting sort on the first two bytes, each thread on a slice of the string
+            void radix()
+            {
+                std::vector<std::uint32_t> counts(std::size_t(threads) * BUCKETS);
+                auto slice = [this](unsigned t) { return std::uint32_t(std::uint64_t(n) * t / threads); };
+                parallel(threads, [&](unsigned t) {
+                    std::uint32_t *c = &counts[std::size_t(t) * BUCKETS];
+                    for (std::uint32_t i = slice(t); i < slice(t + 1); i++)
+                        c[key(i)]++;
+                });
+                std::vector<Range> buckets;
+                std::uint32_t sum = 0;
+                for (unsigned k = 0; k < BUCKETS; k++) {
+                    const std::uint32_t start = sum;
+                    for (unsigned t = 0; t < threads; t++) {
+                        const std::uint32_t c = counts[std::size_t(t) * BUCKETS + k];
+                        counts[std::size_t(t) * BUCKETS + k] = sum;
+                        sum += c;
+                    }
+                    if (sum - start > 1)
+                        buckets.push_back(Range{ start, sum, 2 });
+                }
+                parallel(threads, [&](unsigned t) {
+                    std::uint32_t *c = &counts[std::size_t(t) * BUCKETS];
+                    for (std::uint32_t i = slice(t); i < slice(t + 1); i++)
+                        sa[c[key(i)]++] = i;
+                });
+
+                // the largest buckets first, dealt out in turn
+                std::sort(buckets.begin(), buckets.end(),
+                        [](const Range &a, const Range &b) { return a.hi - a.lo > b.hi - b.lo; });
+                pending = buckets.size();
+                queued = buckets.size();
+                for (std::size_t j = 0; j < buckets.size(); j++)
+                    workers[j % threads].ranges.push_back(buckets[j]);
+            }
+
+            // a thread out of ranges sleeps until one is shared or all are sorted
+            void work(unsigned t)
+            {
+                while (left <= most) {
+                    Range r;
+                    if (take(t, r) || steal(t, r)) {
+                        sortRange(t, r);
+                        if (--pending == 0 || left > most)
+                            notify();
+                        continue;
+                    }
+                    std::unique_lock<std::mutex> lock(idle);
+                    changed.wait(lock, [this] { return queued > 0 || pending == 0 || left > most; });
+                    if (pending == 0)
+                        return;
+                }
+            }
+
+            // under the lock, so that a thread about to wait sees the change
+            void notify(bool all = true)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(idle);
+                }
+                if (all)
+                    changed.notify_all();
+                else
+                    changed.notify_one();
+            }
+
+            // newest range of thread t
+            bool take(unsigned t, Range &r)
+            {
+                Worker &w = workers[t];
+                std::lock_guard<std::mutex> lock(w.mutex);
+                if (w.ranges.empty())
+                    return false;
+                r = w.ranges.back();
+                w.ranges.pop_back();
+                queued--;
+                return true;
+            }
+
+            // oldest range of any other thread
+            bool steal(unsigned t, Range &r)
+            {
+                for (unsigned k = 1; k < threads; k++) {
+                    Worker &w = workers[(t + k) % threads];
+                    std::lock_guard<std::mutex> lock(w.mutex);
+                    if (!w.ranges.empty()) {
+                        r = w.ranges.front();
+                        w.ranges.pop_front();
+                        queued--;
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            void share(unsigned t, const Range &r)
+            {
+                pending++;
+                {
+                    Worker &w = workers[t];
+                    std::lock_guard<std::mutex> lock(w.mutex);
+                    w.ranges.push_back(r);
+                }
+                queued++;
+                notify(false);
+            }
+
+            // bytes [depth, depth + 8) of a row, the first one highest
+            std::uint64_t at(std::uint32_t row, std::uint32_t depth) const
+            {
+                std::uint64_t w;
+                std::memcpy(&w, d + sa[row] + depth, sizeof(w));
+                return __builtin_bswap64(w);
+            }
+
+            void defer(unsigned t, std::uint32_t lo, std::uint32_t hi)
+            {
+                workers[t].done.push_back(Group(lo, hi));
+                left += hi - lo;
+            }
+
+            // 3-way radix quicksort of r on eight bytes at a time, keeping
+            // small parts on a stack of its own
+            void sortRange(unsigned t, const Range &r)
+            {
+                std::vector<Range> stack(1, r);
+                while (!stack.empty() && left <= most) {
+                    const Range q = stack.back();
+                    stack.pop_back();
+                    const std::uint32_t size = q.hi - q.lo;
+                    if (size < 2)
+                        continue;
+                    if (q.depth >= limit) {
+                        defer(t, q.lo, q.hi);
+                        continue;
+                    }
+                    if (size <= bw::ParallelSuffixSort::SMALL) {
+                        sortSmall(t, q);
+                        continue;
+                    }
+
+                    // median of three words as the pivot
+                    std::uint64_t x = at(q.lo, q.depth), y = at(q.lo + size / 2, q.depth), z = at(q.hi - 1, q.depth);
+                    if (x > y)
+                        std::swap(x, y);
+                    const std::uint64_t v = std::max(x, std::min(y, z));
+                    std::uint32_t lt = q.lo, gt = q.hi, i = q.lo;
+                    while (i < gt) {
+                        const std::uint64_t c = at(i, q.depth);
+                        if (c < v)
+                            std::swap(sa[lt++], sa[i++]);
+                        else if (c > v)
+                            std::swap(sa[i], sa[--gt]);
+                        else
+                            i++;
+                    }
+
+                    // rows [lo, lt) < v = [lt, gt) < [gt, hi)
+                    const Range parts[3] = { { q.lo, lt, q.depth }, { gt, q.hi, q.depth }, { lt, gt, q.depth + 8 } };
+                    for (const Range &p : parts) {
+                        if (p.hi - p.lo >= bw::ParallelSuffixSort::SPLIT)
+                            share(t, p);
+                        else if (p.hi - p.lo > 1)
+                            stack.push_back(p);
+                    }
+                }
+            }
+
+            void sortSmall(unsigned t, const Range &q)
+            {
+                const std::size_t left = limit - q.depth;
+                auto compare = [&](std::uint32_t a, std::uint32_t b) {
+                    return std::memcmp(d + a + q.depth, d + b + q.depth, left);
+                };
+                std::sort(sa + q.lo, sa + q.hi, [&](std::uint32_t a, std::uint32_t b) { return compare(a, b) < 0; });
+                for (std::uint32_t i = q.lo; i < q.hi; ) {
+                    std::uint32_t j = i + 1;
+                    while (j < q.hi && compare(sa[i], sa[j]) == 0)
+                        j++;
+                    if (j - i > 1)
+                        defer(t, i, j);
+                    i = j;
+                }
+            }
+    };
+
+    // Prefix doubling on the groups of rows equal in at least h bytes: sorting a
+    // group on the rank of the rotations h bytes further sorts it up to 2h.
+    // The rank of a row is the last row of its group. Returns the groups of
+    // identical rotations.
+    std::vector<Group> doubling(std::uint32_t n, std::uint32_t *sa, unsigned threads, std::vector<Group> groups,
+            std::uint64_t h)
+    {
+        typedef std::pair<std::uint32_t, std::uint32_t> Keyed;     // rank h bytes further, start
+        // groups handed out at a time
+        const std::size_t CHUNK = 256;
+
+        std::vector<std::uint32_t> rank(n), keys(n);
+        auto slice = [&](unsigned t) { return std::uint32_t(std::uint64_t(n) * t / threads); };
+        parallel(threads, [&](unsigned t) {
+            for (std::uint32_t k = slice(t); k < slice(t + 1); k++)
+                rank[sa[k]] = k;
+        });
+        for (const Group &g : groups)
+            for (std::uint32_t k = g.first; k < g.second; k++)
+                rank[sa[k]] = g.second - 1;
+
+        while (!groups.empty() && h < n) {
+            std::atomic<std::size_t> next(0);
+            std::atomic<bool> split(false);
+            std::vector<std::vector<Group>> found(threads);
+            parallel(threads, [&](unsigned t) {
+                std::vector<Keyed> rows;
+                bool splits = false;
+                for (std::size_t first; (first = next.fetch_add(CHUNK)) < groups.size(); )
+                    for (std::size_t j = first; j < std::min(first + CHUNK, groups.size()); j++) {
+                        const Group &g = groups[j];
+                        rows.clear();
+                        for (std::uint32_t k = g.first; k < g.second; k++) {
+                            const std::uint64_t p = sa[k] + h;
+                            rows.push_back(Keyed(rank[p >= n ? p - n : p], sa[k]));
+                        }
+                        std::sort(rows.begin(), rows.end(),
+                                [](const Keyed &a, const Keyed &b) { return a.first < b.first; });
+                        for (std::uint32_t k = g.first; k < g.second; k++) {
+                            keys[k] = rows[k - g.first].first;
+                            sa[k] = rows[k - g.first].second;
+                        }
+                        for (std::uint32_t a = g.first; a < g.second; ) {
+                            std::uint32_t b = a + 1;
+                            while (b < g.second && keys[b] == keys[a])
+                                b++;
+                            if (b - a > 1)
+                                found[t].push_back(Group(a, b));
+                            splits |= b - a < g.second - g.first;
+                            a = b;
+                        }
+                    }
+                if (splits)
+                    split = true;
+            });
+            // once no group splits, none ever will: what is left is identical
+            if (!split)
+                return groups;
+
+            // ranks change only once every group has read them
+            next = 0;
+            parallel(threads, [&](unsigned) {
+                for (std::size_t first; (first = next.fetch_add(CHUNK)) < groups.size(); )
+                    for (std::size_t j = first; j < std::min(first + CHUNK, groups.size()); j++)
+                        for (std::uint32_t k = groups[j].first, b = k; k < groups[j].second; k++) {
+                            if (k == b)
+                                while (++b < groups[j].second && keys[b] == keys[k])
+                                    ;
+                            rank[sa[k]] = b - 1;
+                        }
+            });
+            groups.clear();
+            for (const std::vector<Group> &f : found)
+                groups.insert(groups.end(), f.begin(), f.end());
+            h *= 2;
+        }
+        return groups;
+    }
+}
+
+bool bw::ParallelSuffixSort::sort(const unsigned char *s, std::uint32_t n, std::uint32_t *sa, unsigned threads,
+        std::vector<Group> &ties)
+{
+    ties.clear();
+    if (n == 0)
+        return true;
+    if (threads == 0)
+        threads = 1;
+    // words are read up to 8 bytes past the end of a rotation
+    std::string doubled(2 * std::size_t(n) + 8, '\0');
+    for (std::size_t i = 0; i < doubled.size(); i++)
+        doubled[i] = s[i % n];
+    const unsigned char *d = reinterpret_cast<const unsigned char *>(doubled.data());
+
+    // a string no longer than DEPTH is sorted whole, ties and all
+    Sorter sorter(d, n, sa, threads, n <= DEPTH ? n : n / REPEATS);
+    std::vector<Group> groups;
+    if (!sorter.sort(groups))
+        return false;
+    if (n <= DEPTH) {
+        ties.swap(groups);
+        return true;
+    }
+    std::string().swap(doubled);
+    if (!groups.empty())
+        ties = doubling(n, sa, threads, groups, DEPTH);
+    return true;
+}
@@ -0,0 +1,54 @@
+#ifndef _PARALLELSUFFIXSORT_H_
+#define _PARALLELSUFFIXSORT_H_
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+namespace bw {
+    // Sorts the rotations of one string on several threads. A radix pass on
+    // the first two bytes splits the rotations into 65536 buckets, counted
+    // and scattered by all threads at once; the buckets are then sorted by
+    // 3-way radix quicksort from their third byte. Every thread owns a deque
+    // of ranges: it splits its own ranges depth first and shares the large
+    // parts, takes the oldest range of another thread when its own run out,
+    // and sleeps while no thread has one to spare. Rotations still equal after DEPTH bytes (long repeats, where
+    // radix quicksort degrades) are sorted by prefix doubling (Larsson &
+    // Sadakane) instead, each round sorting the remaining groups
+    // concurrently on the ranks of the rotations h bytes further. Every
+    // round goes over all of them, so strings made mostly of long repeats
+    // are left to SA-IS.
+    class ParallelSuffixSort {
+        public:
+            // bytes compared by radix quicksort before prefix doubling takes over
+            static const unsigned DEPTH = 64;
+            // ranges at least this large are shared with other threads
+            static const std::size_t SPLIT = 4096;
+            // ranges at most this large are sorted by comparison
+            static const std::size_t SMALL = 16;
+            // at most one rotation in this many may be left to prefix doubling
+            static const unsigned REPEATS = 8;
+
+            // rows [first, second) of the array
+            typedef std::pair<std::uint32_t, std::uint32_t> Group;
+
+        private:
+            // Do not instantiate.
+            ParallelSuffixSort()
+            {
+            }
+
+        public:
+            // fill sa[0..n) with the start of each rotation of s[0..n) in
+            // sorted order, on the given number of threads (at least 1).
+            // Identical rotations, which only a periodic string has, are left
+            // in no particular order and their rows returned in ties. Returns
+            // false, with sa in no order, when more than n / REPEATS rotations
+            // share their first DEPTH bytes with another.
+            bool static sort(const unsigned char *s, std::uint32_t n, std::uint32_t *sa, unsigned threads,
+                    std::vector<Group> &ties);
+    };
+}
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <cstddef>
+
+#include "Stats.h"
+
+namespace bw
+{
+    // FIFO of at most `depth` items between two threads. push() waits while
+    // it is full and pop() while it is empty; once closed, push() drops its
+    // item and returns false and pop() returns false when nothing is left.
+    template <typename T>
+    class BlockQueue {
+        private:
+            std::deque<T> items;
+            std::size_t depth;
+            bool closed;
+            std::mutex mutex;
+            std::condition_variable changed;
+
+        public:
+            BlockQueue(const BlockQueue &that)=delete;
+            BlockQueue &operator=(const BlockQueue &that)=delete;
+
+            explicit BlockQueue(std::size_t _depth)
+                :depth(_depth ? _depth : 1), closed(false)
+            {
+            }
+
+            bool push(T item)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return closed || items.size() < depth; });
+                if (closed)
+                    return false;
+                items.push_back(std::move(item));
+                changed.notify_all();
+                return true;
+            }
+
+            bool pop(T &item)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return closed || !items.empty(); });
+                if (items.empty())
+                    return false;
+                item = std::move(items.front());
+                items.pop_front();
+                changed.notify_all();
+                return true;
+            }
+
+            void close()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closed = true;
+                changed.notify_all();
+            }
+    };
+
+    // Produces items on a thread of its own, at most `depth` ahead of the
+    // caller: produce(item) is called until it returns false, so that reading
+    // input (or faulting in the pages of a mapped file) overlaps the work
+    // done on what was read before. An exception thrown by produce is rethrown
+    // by the caller's next() once the items before it are taken.
+    template <typename T>
+    class ReadAhead {
+        private:
+            BlockQueue<T> queue;
+            std::exception_ptr error;
+            std::thread thread;
+
+        public:
+            ReadAhead(const ReadAhead &that)=delete;
+            ReadAhead &operator=(const ReadAhead &that)=delete;
+
+            ReadAhead(std::function<bool(T &)> produce, std::size_t depth)
+                :queue(depth)
+            {
+                thread = std::thread([this, produce] {
+                    try {
+                        T item;
+                        while (produce(item) && queue.push(std::move(item)))
+                            ;
+                    }
+                    catch (...) {
+                        error = std::current_exception();
+                    }
+                    queue.close();
+                });
+            }
+
+            // stops the producer after the item it is on
+            ~ReadAhead()
+            {
+                queue.close();
+                thread.join();
+            }
+
+            bool next(T &item)
+            {
+                if (queue.pop(item))
+                    return true;
+                if (error)
+                    std::rethrow_exception(error);
+                return false;
+            }
+    };
+
+    // Writes to a sink on a thread of its own, so that writing one block
+    // overlaps compressing (or expanding) the next: buffers are handed over
+    // whole, at most `depth` waiting at a time. The first error of the sink
+    // is rethrown by the next write() or by finish(); the sink is flushed by
+    // its owner once finish() has returned.
+    template <typename Sink>
+    class WriteBehind {
+        private:
+            Sink &sink;
+            BlockQueue<std::string> queue;
+            std::exception_ptr error;       // set by the writer before failed
+            std::atomic<bool> failed;
+            std::thread thread;
+
+        public:
+            WriteBehind(const WriteBehind &that)=delete;
+            WriteBehind &operator=(const WriteBehind &that)=delete;
+
+            WriteBehind(Sink &_sink, std::size_t depth)
+                :sink(_sink), queue(depth), failed(false)
+            {
+                thread = std::thread([this] { run(); });
+            }
+
+            // writes what was handed over already
+            ~WriteBehind()
+            {
+                queue.close();
+                if (thread.joinable())
+                    thread.join();
+            }
+
+            WriteBehind &write(std::string buffer)
+            {
+                check();
+                queue.push(std::move(buffer));
+                return *this;
+            }
+            WriteBehind &write(const char *s, std::size_t n)
+            {
+                return write(std::string(s, n));
+            }
+
+            // wait until everything handed over is written
+            void finish()
+            {
+                queue.close();
+                thread.join();
+                check();
+            }
+
+        private:
+            void check()
+            {
+                if (failed)
+                    std::rethrow_exception(error);
+            }
+
+            // after an error the rest is dropped, so the caller is never kept waiting
+            void run()
+            {
+                std::string buffer;
+                while (queue.pop(buffer)) {
+                    if (failed)
+                        continue;
+                    try {
+                        BW_STATS_TIMER(timer, WRITE, buffer.size());
+                        BW_STATS_OUTPUT(timer, buffer.size());
+                        sink.write(buffer.data(), buffer.size());
+                    }
+                    catch (...) {
+                        error = std::current_exception();
+                        failed = true;
+                    }
+                }
+            }
+    };
+}
+
+#endif
@@ -1 +1,3 @@
 #include "Quick3stringEx.h"
+
+const int bw::Quick3stringEx::CUTOFF;
@@ -3,59 +3,80 @@
 
 #include <string>
 #include <cstring>
+#include <cstddef>
 #include <vector>
 #include <cassert>
 #include <algorithm>
-#include <memory>
+#include <random>
+#include <cstdint>
+
+#include "Stats.h"
 
 namespace bw {
+    // 3-way radix quicksort of the suffixes of a string. All state lives on
+    // the stack of sort(), so concurrent sorts do not interfere. Offsets are
+    // 32-bit, so the suffixes sorted must start below 4 GB.
     class Quick3stringEx {
         private:
             static const int CUTOFF =  15;   // cutoff to insertion sort
-            std::shared_ptr<std::string> buff;
-            unsigned bufflen;
+
+            // figures of one sort, handed to Stats when it is done
+            struct Trace {
+                std::uint64_t comparisons;
+                unsigned depth;
+                unsigned maxDepth;
+            };
+
+            // Do not instantiate.
+            Quick3stringEx()
+            {
+            }
+
         public:
-            Quick3stringEx(const Quick3stringEx &ex)=delete;
-            Quick3stringEx() { };
-            Quick3stringEx &operator=(const Quick3stringEx &ex)=delete;
             /**
-             * Rearranges the array of strings in ascending order.
+             * Rearranges the array of suffix offsets of b in ascending order.
              *
              * @param a the array to be sorted
              */
+            void static sort(std::vector<std::uint32_t> &a, const std::string &b) {
+                const unsigned char *s = reinterpret_cast<const unsigned char *>(b.data());
+                const std::size_t n = b.size();
 
-            void sort(std::vector<int> &a, const std::string &b) {
-                buff = std::shared_ptr<std::string>(new std::string(b));
-                bufflen = b.size();
-                std::random_shuffle ( a.begin(), a.end() );
-                sort(a, 0, a.size()-1, 0);
-                assert(isSorted(a));
-            }
+                // shuffle against adversarial input with a private generator
+                std::minstd_rand rng(a.size());
+                std::shuffle(a.begin(), a.end(), rng);
+                Trace trace = { 0, 0, 0 };
+                if (!a.empty())
+                    sort(s, n, a, 0, std::ptrdiff_t(a.size())-1, 0, trace);
+                assert(isSorted(s, n, a));
 
-            std::string getString(int base, int d) {
-                return buff->substr(base, base + d);
+                BW_STATS_ADD(QUICK3_SORTS, 1);
+                BW_STATS_ADD(QUICK3_COMPARISONS, trace.comparisons);
+                BW_STATS_PEAK(QUICK3_DEPTH, trace.maxDepth);
             }
 
-            //return the dth character of s, -1 if d = length of s
         private:
-            int charAt(int base, unsigned d) const {
-                assert(d <= bufflen);
-                return d == bufflen ? -1 : static_cast<int>(static_cast<unsigned char>(buff->operator[](base + d)));
+            //return the dth character of the suffix at base, -1 past its end
+            int static charAt(const unsigned char *s, std::size_t n, std::size_t base, std::size_t d) {
+                return base + d >= n ? -1 : s[base + d];
             }
 
             //3-way string quicksort a[lo..hi] starting at dth character
-            void sort(std::vector<int>& a, int lo, int hi, int d) {
+            void static sort(const unsigned char *s, std::size_t n, std::vector<std::uint32_t>& a,
+                    std::ptrdiff_t lo, std::ptrdiff_t hi, std::size_t d, Trace &trace) {
                 //
                 // cutoff to insertion sort for small subarrays
                 if (hi <= lo + CUTOFF) {
-                    insertion(a, lo, hi, d);
+                    insertion(s, n, a, lo, hi, d, trace);
                     return;
                 }
-                int lt = lo, gt = hi;
-                int v = charAt(a[lo], d);
-                int i = lo + 1;
+                BW_STATS_ONLY(trace.maxDepth = std::max(trace.maxDepth, ++trace.depth));
+                BW_STATS_ONLY(trace.comparisons += hi - lo);
+                std::ptrdiff_t lt = lo, gt = hi;
+                int v = charAt(s, n, a[lo], d);
+                std::ptrdiff_t i = lo + 1;
                 while (i <= gt) {
-                    int t = charAt(a[i], d);
+                    int t = charAt(s, n, a[i], d);
                     if (t < v) exch(a, lt++, i++);
                     else if (t > v) exch(a, i, gt--);
                     else i++;
@@ -63,44 +84,45 @@ namespace bw {
 
                 // a[lo..lt-1] < v = a[lt..gt] < a[gt+1..hi].
 
-                sort(a, lo, lt-1, d);
-                if (v >= 0) sort(a, lt, gt, d+1);
-                sort(a, gt+1, hi, d);
+                sort(s, n, a, lo, lt-1, d, trace);
+                if (v >= 0) sort(s, n, a, lt, gt, d+1, trace);
+                sort(s, n, a, gt+1, hi, d, trace);
+                BW_STATS_ONLY(trace.depth--);
             }
 
             // sort from a[lo] to a[hi], starting at the dth character
-            void insertion(std::vector<int> &a, int lo, int hi, int d) {
-                for (int i = lo; i <= hi; i++)
-                    for (int j = i; j > lo && less(a[j], a[j-1], d); j--)
+            void static insertion(const unsigned char *s, std::size_t n, std::vector<std::uint32_t> &a,
+                    std::ptrdiff_t lo, std::ptrdiff_t hi, std::size_t d, Trace &trace) {
+                for (std::ptrdiff_t i = lo; i <= hi; i++)
+                    for (std::ptrdiff_t j = i; j > lo; j--) {
+                        BW_STATS_ONLY(trace.comparisons++);
+                        if (!less(s, n, a[j], a[j-1], d))
+                            break;
                         exch(a, j, j-1);
+                    }
             }
 
 
             // exchange a[i] and a[j]
-            void exch(std::vector<int> &a, int i, int j) {
-                int temp = a[i];
+            void static exch(std::vector<std::uint32_t> &a, std::ptrdiff_t i, std::ptrdiff_t j) {
+                std::uint32_t temp = a[i];
                 a[i] = a[j];
                 a[j] = temp;
             }
 
-            // is v less than w, starting at character d
-            // DEPRECATED BECAUSE OF SLOW SUBSTRING EXTRACTION IN JAVA 7
-            // private static boolean less(String v, String w, int d) {
-            //    assert v.substring(0, d).equals(w.substring(0, d));
-            //    return v.substring(d).compareTo(w.substring(d)) < 0;
-            // }
-
-            // is v less than w, starting at character d
-            bool less(int v, int w, int d) const {
-                return std::strcmp(buff->data() + d + v, buff->data() + d + w) < 0;
+            // is suffix v less than suffix w, starting at character d; a proper
+            // prefix sorts first and embedded NUL bytes compare as any other byte
+            bool static less(const unsigned char *s, std::size_t n, std::size_t v, std::size_t w, std::size_t d) {
+                const std::size_t lv = n - v - d, lw = n - w - d;
+                const int c = std::memcmp(s + v + d, s + w + d, std::min(lv, lw));
+                return c < 0 || (c == 0 && lv < lw);
             }
 
             // is the array sorted
-            bool isSorted(const std::vector<int> &a) const {
-                for (unsigned i = 1; i < a.size(); i++)
-                    if (less(a[i], a[i-1], 0))
+            bool static isSorted(const unsigned char *s, std::size_t n, const std::vector<std::uint32_t> &a) {
+                for (std::size_t i = 1; i < a.size(); i++)
+                    if (less(s, n, a[i], a[i-1], 0))
                         return false;
-                    //if (getString(a[i], bufflen) > getString(a[i-1], bufflen)) return false;
                 return true;
             }
     };
@@ -0,0 +1,9 @@
+#include "Rans.h"
+
+const unsigned bw::Rans::SCALE_BITS;
+const unsigned bw::Rans::WAYS;
+const unsigned bw::Rans::MAX_SYMBOLS;
+const std::uint32_t bw::Rans::TOTAL;
+const std::uint32_t bw::Rans::LOWER;
+const unsigned bw::Rans::MAX_TABLES;
+const unsigned bw::Rans::GROUP_SIZE;
@@ -0,0 +1,377 @@
+#ifndef _RANS_H_
+#define _RANS_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+#include "BitReader.h"
+#include "BitWriter.h"
+#include "Huffman.h"
+#include "Stats.h"
+
+namespace bw
+{
+    // Range variant of asymmetric numeral systems (Duda 2013), laid out as in
+    // ryg_rans: an alternative to Huffman for the symbols of one block that
+    // spends fractions of a bit on very frequent symbols. Groups of
+    // GROUP_SIZE symbols pick one of several frequency tables, chosen as
+    // Huffman::compressTables() chooses its codes. Frequencies are quantised
+    // to SCALE_BITS bits and the WAYS states take the symbols of a group in
+    // turn. A state stays in [LOWER, LOWER << 16) and moves at most one 16-bit
+    // word per symbol, so decoding is a table lookup, a multiply-add and a
+    // masked shift, without branches, with the WAYS chains overlapping.
+    //
+    // Layout: number of symbols:32, number of tables:3, the selectors as in
+    // Huffman, then the quantised frequency of every symbol in every table,
+    // Elias gamma coded, padded to a byte; number of words:32; the WAYS
+    // final states:32; then the words, in decoding order.
+    class Rans {
+        public:
+            static const unsigned SCALE_BITS = 12;
+            static const unsigned WAYS = 4;
+            static const unsigned MAX_SYMBOLS = Huffman::MAX_SYMBOLS;
+            static const unsigned MAX_TABLES = Huffman::MAX_TABLES;
+            static const unsigned GROUP_SIZE = Huffman::GROUP_SIZE;
+
+        private:
+            static const std::uint32_t TOTAL = 1u << SCALE_BITS;
+            static const std::uint32_t LOWER = 1u << 15;
+
+            // encoder of one symbol: division by its frequency through a
+            // reciprocal, valid for states below 2^31
+            struct EncSymbol {
+                std::uint32_t xMax;     // states at or above it shed a word first
+                std::uint32_t rcpFreq;
+                std::uint32_t bias;
+                std::uint32_t cmplFreq;
+                unsigned rcpShift;
+            };
+
+            // decoder entry of one slot of [0, TOTAL)
+            struct DecSlot {
+                std::uint16_t symbol;
+                std::uint16_t freq;
+                std::uint16_t offset;   // slot - start of the symbol
+                std::uint16_t unused;
+            };
+
+            // Do not instantiate.
+            Rans()
+            {
+            }
+
+        public:
+            // append the coded form of n symbols of an alphabet of the given size to out
+            template <typename T>
+            void static compress(const T *in, std::size_t n, unsigned symbols, std::string &out) {
+                if (symbols > MAX_SYMBOLS)
+                    throw std::invalid_argument("rANS alphabet too large");
+                if (n > UINT32_MAX)
+                    throw std::length_error("rANS block too large");
+                BW_STATS_TIMER(timer, RANS_ENCODE, n);
+                BW_STATS_ONLY(const std::size_t start = out.size());
+
+                const std::size_t groups = (n + GROUP_SIZE - 1) / GROUP_SIZE;
+                std::vector<unsigned char> selector;
+                std::uint64_t count[MAX_TABLES][MAX_SYMBOLS];
+                unsigned len[MAX_TABLES][MAX_SYMBOLS];
+                const unsigned tables = Huffman::selectTables(in, n, symbols, selector, count, len);
+
+                std::uint32_t freq[MAX_TABLES][MAX_SYMBOLS];
+                for (unsigned t = 0; t < tables; t++)
+                    normalize(count[t], symbols, freq[t]);
+
+                {
+                    BitWriter header(out);
+                    header.writeBits(n, 32);
+                    header.writeBits(tables, 3);
+                    Huffman::writeSelectors(selector, tables, header);
+                    for (unsigned t = 0; t < tables; t++)
+                        for (unsigned s = 0; s < symbols; s++)
+                            writeGamma(freq[t][s] + 1, header);
+                    header.flush();
+                }
+
+                std::vector<EncSymbol> enc(tables * MAX_SYMBOLS);
+                for (unsigned t = 0; t < tables; t++)
+                    for (unsigned s = 0, cum = 0; s < symbols; cum += freq[t][s], s++)
+                        if (freq[t][s])
+                            enc[t * MAX_SYMBOLS + s] = encSymbol(cum, freq[t][s]);
+
+                // symbols go last to first, each state pushing its words in front
+                std::vector<std::uint16_t> words(n);
+                std::uint16_t *const end = words.data() + n;
+                std::uint16_t *p = end;
+                std::uint32_t x[WAYS];
+                for (unsigned j = 0; j < WAYS; j++)
+                    x[j] = LOWER;
+                for (std::size_t g = groups; g-- > 0; ) {
+                    const EncSymbol *e = &enc[selector[g] * MAX_SYMBOLS];
+                    const std::size_t begin = g * GROUP_SIZE;
+                    for (std::size_t k = std::min<std::size_t>(n - begin, GROUP_SIZE); k-- > 0; ) {
+                        const EncSymbol &es = e[in[begin + k]];
+                        std::uint32_t &s = x[k % WAYS];
+                        if (s >= es.xMax) {
+                            *--p = s;
+                            s >>= 16;
+                        }
+                        const std::uint32_t q = std::uint32_t((std::uint64_t(s) * es.rcpFreq) >> 32) >> es.rcpShift;
+                        s += es.bias + q * es.cmplFreq;
+                    }
+                }
+
+                const std::uint32_t used = end - p;
+                out.append(reinterpret_cast<const char *>(&used), sizeof(used));
+                out.append(reinterpret_cast<const char *>(x), sizeof(x));
+                out.append(reinterpret_cast<const char *>(p), used * sizeof(std::uint16_t));
+                BW_STATS_OUTPUT(timer, out.size() - start);
+                BW_STATS_ADD(SYMBOLS, n);
+            }
+
+            // expand one message written by compress() from in[0..n) into out, a
+            // std::string or a std::vector<std::uint16_t>, refusing more than limit
+            // symbols; returns the number of bytes of in it took
+            template <typename Buffer>
+            std::size_t static expand(const unsigned char *in, std::size_t n, Buffer &out, unsigned symbols,
+                    std::size_t limit) {
+                if (symbols > MAX_SYMBOLS)
+                    throw std::invalid_argument("rANS alphabet too large");
+                BW_STATS_TIMER(timer, RANS_DECODE, 0);
+
+                BitReader header(in, n);
+                const std::size_t length = header.readBits(32);
+                const unsigned tables = header.readBits(3);
+                if (length > limit || tables == 0 || tables > MAX_TABLES)
+                    throw std::runtime_error("Corrupted rANS header");
+                std::vector<unsigned char> selector((length + GROUP_SIZE - 1) / GROUP_SIZE);
+                Huffman::readSelectors(header, selector, tables);
+
+                // a table no group uses may be empty
+                std::vector<DecSlot> table(tables * TOTAL);
+                for (unsigned t = 0; t < tables; t++) {
+                    DecSlot *d = &table[t * TOTAL];
+                    std::uint32_t cum = 0;
+                    for (unsigned s = 0; s < symbols; s++) {
+                        const std::uint32_t freq = readGamma(header) - 1;
+                        if (freq > TOTAL - cum)
+                            throw std::runtime_error("Corrupted rANS header");
+                        for (std::uint32_t k = 0; k < freq; k++, d++) {
+                            d->symbol = s;
+                            d->freq = freq;
+                            d->offset = k;
+                        }
+                        cum += freq;
+                    }
+                    if (cum != 0 && cum != TOTAL)
+                        throw std::runtime_error("Corrupted rANS header");
+                }
+                header.align();
+                if (header.overrun())
+                    throw std::runtime_error("Truncated rANS header");
+
+                std::size_t at = header.bitCount() / 8;
+                std::uint32_t used, x[WAYS];
+                if (n < at + sizeof(used) + sizeof(x))
+                    throw std::runtime_error("Truncated rANS stream");
+                std::memcpy(&used, in + at, sizeof(used));
+                std::memcpy(x, in + at + sizeof(used), sizeof(x));
+                at += sizeof(used) + sizeof(x);
+                if (n - at < std::uint64_t(used) * sizeof(std::uint16_t))
+                    throw std::runtime_error("Truncated rANS stream");
+                const unsigned char *p = in + at;
+                const unsigned char *const end = p + used * sizeof(std::uint16_t);
+
+                out.resize(length);
+                if (length)
+                    decode(table.data(), selector, x, p, end, &out[0], length);
+                // the encoder started every state at LOWER and wrote no spare words
+                for (unsigned j = 0; j < WAYS; j++)
+                    if (x[j] != LOWER)
+                        throw std::runtime_error("Corrupted rANS stream");
+                if (p != end)
+                    throw std::runtime_error("Corrupted rANS stream");
+                BW_STATS_INPUT(timer, end - in);
+                BW_STATS_OUTPUT(timer, length);
+                return end - in;
+            }
+
+        private:
+            // one decoding step of state x: its symbol, then at most one word in,
+            // read whether or not it is taken
+            template <typename T>
+            void static step(const DecSlot *table, std::uint32_t &x, const unsigned char *&p, T &symbol) {
+                const DecSlot d = table[x & (TOTAL - 1)];
+                symbol = d.symbol;
+                x = d.freq * (x >> SCALE_BITS) + d.offset;
+                std::uint16_t w;
+                std::memcpy(&w, p, sizeof(w));
+                const std::uint32_t refill = x < LOWER;
+                x = x << (16 * refill) | (w & (0u - refill));
+                p += refill * sizeof(w);
+            }
+
+            // One step of all four states over o[0..4). They decode side by side,
+            // then those below LOWER take the next words in state order, picked
+            // out of one load of four words, so the states never wait on each
+            // other's reads.
+            template <typename T>
+            void static round(const DecSlot *table, std::uint32_t &x0, std::uint32_t &x1, std::uint32_t &x2,
+                    std::uint32_t &x3, const unsigned char *&p, T *o) {
+                const DecSlot d0 = table[x0 & (TOTAL - 1)];
+                const DecSlot d1 = table[x1 & (TOTAL - 1)];
+                const DecSlot d2 = table[x2 & (TOTAL - 1)];
+                const DecSlot d3 = table[x3 & (TOTAL - 1)];
+                o[0] = d0.symbol;
+                o[1] = d1.symbol;
+                o[2] = d2.symbol;
+                o[3] = d3.symbol;
+                x0 = d0.freq * (x0 >> SCALE_BITS) + d0.offset;
+                x1 = d1.freq * (x1 >> SCALE_BITS) + d1.offset;
+                x2 = d2.freq * (x2 >> SCALE_BITS) + d2.offset;
+                x3 = d3.freq * (x3 >> SCALE_BITS) + d3.offset;
+
+                std::uint64_t w;
+                std::memcpy(&w, p, sizeof(w));
+                const unsigned r0 = x0 < LOWER, r1 = x1 < LOWER, r2 = x2 < LOWER, r3 = x3 < LOWER;
+                const unsigned k1 = r0, k2 = k1 + r1, k3 = k2 + r2;
+                // shifts and masks rather than selects, which compilers turn into branches
+                x0 = x0 << (16 * r0) | (word(w, 0) & (0u - r0));
+                x1 = x1 << (16 * r1) | (word(w, k1) & (0u - r1));
+                x2 = x2 << (16 * r2) | (word(w, k2) & (0u - r2));
+                x3 = x3 << (16 * r3) | (word(w, k3) & (0u - r3));
+                p += (k3 + r3) * sizeof(std::uint16_t);
+            }
+
+            // word k of four loaded at once
+            std::uint32_t static word(std::uint64_t w, unsigned k) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                return std::uint16_t(w >> (48 - 16 * k));
+#else
+                return std::uint16_t(w >> (16 * k));
+#endif
+            }
+
+            // same near the end of the words, checking there is one to read
+            template <typename T>
+            void static stepChecked(const DecSlot *table, std::uint32_t &x, const unsigned char *&p,
+                    const unsigned char *end, T &symbol) {
+                if (end - p >= std::ptrdiff_t(sizeof(std::uint16_t))) {
+                    step(table, x, p, symbol);
+                    return;
+                }
+                const DecSlot d = table[x & (TOTAL - 1)];
+                symbol = d.symbol;
+                x = d.freq * (x >> SCALE_BITS) + d.offset;
+                if (x < LOWER)
+                    throw std::runtime_error("Truncated rANS stream");
+            }
+
+            template <typename T>
+            void static decode(const DecSlot *table, const std::vector<unsigned char> &selector, std::uint32_t *x,
+                    const unsigned char *&p, const unsigned char *end, T *out, std::size_t length) {
+                static_assert(WAYS == 4, "the main loop runs four states");
+                std::uint32_t x0 = x[0], x1 = x[1], x2 = x[2], x3 = x[3];
+                for (std::size_t g = 0; g < selector.size(); g++) {
+                    const DecSlot *t = table + selector[g] * TOTAL;
+                    T *o = out + g * GROUP_SIZE;
+                    const std::size_t m = std::min<std::size_t>(length - g * GROUP_SIZE, GROUP_SIZE);
+                    std::size_t k = 0;
+                    // a group takes at most one word per symbol, so a group far
+                    // enough from the end needs no bounds checks
+                    if (end - p >= std::ptrdiff_t(GROUP_SIZE * sizeof(std::uint16_t))) {
+                        for (; k + WAYS <= m; k += WAYS)
+                            round(t, x0, x1, x2, x3, p, o + k);
+                        if (k < m)
+                            step(t, x0, p, o[k++]);
+                        if (k < m)
+                            step(t, x1, p, o[k++]);
+                        if (k < m)
+                            step(t, x2, p, o[k++]);
+                        continue;
+                    }
+                    for (; k < m; k++) {
+                        std::uint32_t &s = k % WAYS == 0 ? x0 : k % WAYS == 1 ? x1 : k % WAYS == 2 ? x2 : x3;
+                        stepChecked(t, s, p, end, o[k]);
+                    }
+                }
+                x[0] = x0;
+                x[1] = x1;
+                x[2] = x2;
+                x[3] = x3;
+            }
+
+            EncSymbol static encSymbol(std::uint32_t start, std::uint32_t freq) {
+                EncSymbol e;
+                e.xMax = ((LOWER >> SCALE_BITS) << 16) * freq;
+                e.cmplFreq = TOTAL - freq;
+                if (freq < 2) {
+                    // q = x - 1 and a bias making up for it
+                    e.rcpFreq = ~0u;
+                    e.rcpShift = 0;
+                    e.bias = start + TOTAL - 1;
+                }
+                else {
+                    unsigned shift = 0;
+                    while (freq > (1u << shift))
+                        shift++;
+                    e.rcpFreq = ((std::uint64_t(1) << (shift + 31)) + freq - 1) / freq;
+                    e.rcpShift = shift - 1;
+                    e.bias = start;
+                }
+                return e;
+            }
+
+            // scale counts to frequencies adding up to TOTAL, every symbol that
+            // occurs keeping at least 1; the rounding error goes where it costs
+            // the fewest bits. No counts give no frequencies.
+            void static normalize(const std::uint64_t *count, unsigned symbols, std::uint32_t *freq) {
+                std::uint64_t n = 0;
+                for (unsigned s = 0; s < symbols; s++)
+                    n += count[s];
+                std::uint32_t sum = 0;
+                for (unsigned s = 0; s < symbols; s++) {
+                    freq[s] = count[s] ? std::max<std::uint64_t>(1, (count[s] * TOTAL + n / 2) / n) : 0;
+                    sum += freq[s];
+                }
+                if (n == 0)
+                    return;
+                while (sum > TOTAL) {
+                    unsigned best = symbols;
+                    for (unsigned s = 0; s < symbols; s++)
+                        if (freq[s] > 1 && (best == symbols || count[s] * freq[best] < count[best] * freq[s]))
+                            best = s;
+                    freq[best]--;
+                    sum--;
+                }
+                while (sum < TOTAL) {
+                    unsigned best = symbols;
+                    for (unsigned s = 0; s < symbols; s++)
+                        if (freq[s] && (best == symbols || count[s] * freq[best] > count[best] * freq[s]))
+                            best = s;
+                    freq[best]++;
+                    sum++;
+                }
+            }
+
+            // v >= 1 as its length in bits less one zeros, then its bits
+            void static writeGamma(std::uint32_t v, BitWriter &out) {
+                const unsigned bits = 32 - __builtin_clz(v);
+                out.writeBits(0, bits - 1);
+                out.writeBits(v, bits);
+            }
+
+            std::uint32_t static readGamma(BitReader &in) {
+                unsigned zeros = 0;
+                while (!in.readBit())
+                    if (++zeros > SCALE_BITS || in.overrun())
+                        throw std::runtime_error("Corrupted rANS header");
+                return std::uint32_t(1) << zeros | in.readBits(zeros);
+            }
+    };
+}
+
+#endif
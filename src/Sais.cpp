@@ -0,0 +1,3 @@
+#include "Sais.h"
+
+const int bw::Sais::NAIVE_CUTOFF;
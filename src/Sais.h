@@ -0,0 +1,190 @@
+#ifndef _SAIS_H_
+#define _SAIS_H_
+
+#include <vector>
+#include <algorithm>
+
+namespace bw {
+    // Linear time suffix array construction by induced sorting (SA-IS,
+    // Nong, Zhang & Chan 2009). Suffixes are compared without a sentinel:
+    // a suffix that is a prefix of another one sorts first. As in the paper,
+    // the suffix array is the workspace: the sorted LMS substrings, their
+    // names and the reduced string all live in it, so a level needs beyond
+    // sa one bit per symbol and one counter per symbol of its alphabet, and
+    // frees the counters before the next level is sorted.
+    class Sais {
+        private:
+            // below this size a comparison sort is faster than induced sorting
+            static const int NAIVE_CUTOFF = 10;
+
+            // Do not instantiate.
+            Sais()
+            {
+            }
+
+        public:
+            // fill sa[0..n) with the suffix array of s[0..n), whose symbols are in [0, upper];
+            // Index is a signed integer wide enough for n
+            template <typename T, typename Index>
+            void static sort(const T *s, Index *sa, Index n, Index upper)
+            {
+                if (n == 0)
+                    return;
+                if (n == 1) {
+                    sa[0] = 0;
+                    return;
+                }
+                if (n < NAIVE_CUTOFF) {
+                    naive(s, sa, n);
+                    return;
+                }
+
+                // ls[i]: suffix i is S-type (smaller than suffix i+1)
+                std::vector<bool> ls(n);
+                for (Index i = n - 2; i >= 0; i--)
+                    ls[i] = (s[i] == s[i + 1]) ? ls[i + 1] : (s[i] < s[i + 1]);
+
+                // sort the LMS substrings: the LMS suffixes at the ends of
+                // their buckets, in text order, then induce
+                std::fill(sa, sa + n, -1);
+                Index m = 0;
+                {
+                    std::vector<Index> bucket(upper + 1);
+                    buckets(s, n, bucket, true);
+                    for (Index i = 1; i < n; i++)
+                        if (lms(ls, i)) {
+                            sa[--bucket[s[i]]] = i;
+                            m++;
+                        }
+                    induce(s, sa, n, ls, bucket);
+                }
+                if (m == 0)
+                    return;
+
+                // the sorted LMS substrings to sa[0..m), then their names to
+                // sa[m + p / 2] (LMS positions are at least two apart), and
+                // gathered in text order as the reduced string in sa[n - m..n)
+                Index k = 0;
+                for (Index i = 0; i < n; i++)
+                    if (lms(ls, sa[i]))
+                        sa[k++] = sa[i];
+                std::fill(sa + m, sa + n, -1);
+                Index name = 0;
+                for (Index i = 0; i < m; i++) {
+                    if (i > 0 && !sameLms(s, n, ls, sa[i - 1], sa[i]))
+                        name++;
+                    sa[m + sa[i] / 2] = name;
+                }
+                for (Index i = n - 1, j = n; i >= m; i--)
+                    if (sa[i] >= 0)
+                        sa[--j] = sa[i];
+
+                // sort the reduced string into sa[0..m), directly when its symbols are distinct
+                Index *reduced = sa + n - m;
+                if (name + 1 < m)
+                    sort(reduced, sa, m, name);
+                else
+                    for (Index i = 0; i < m; i++)
+                        sa[reduced[i]] = i;
+
+                // the LMS positions replace the reduced string, giving the
+                // sorted LMS suffixes, which go to the ends of their buckets
+                for (Index i = 1, j = n - m; i < n; i++)
+                    if (lms(ls, i))
+                        sa[j++] = i;
+                for (Index i = 0; i < m; i++)
+                    sa[i] = reduced[sa[i]];
+                std::fill(sa + m, sa + n, -1);
+                std::vector<Index> bucket(upper + 1);
+                buckets(s, n, bucket, true);
+                for (Index i = m - 1; i >= 0; i--) {
+                    const Index p = sa[i];
+                    sa[i] = -1;
+                    sa[--bucket[s[p]]] = p;
+                }
+                induce(s, sa, n, ls, bucket);
+            }
+
+        private:
+            // suffix i is leftmost S-type
+            template <typename Index>
+            bool static lms(const std::vector<bool> &ls, Index i)
+            {
+                return i > 0 && ls[i] && !ls[i - 1];
+            }
+
+            // the first (or with ends one past the last) slot of the bucket of every symbol
+            template <typename T, typename Index>
+            void static buckets(const T *s, Index n, std::vector<Index> &bucket, bool ends)
+            {
+                std::fill(bucket.begin(), bucket.end(), 0);
+                for (Index i = 0; i < n; i++)
+                    bucket[s[i]]++;
+                Index sum = 0;
+                for (Index &b : bucket) {
+                    const Index count = b;
+                    sum += count;
+                    b = ends ? sum : sum - count;
+                }
+            }
+
+            // LMS substrings l and r, each up to the next LMS position or the
+            // end, are equal, their last symbols included
+            template <typename T, typename Index>
+            bool static sameLms(const T *s, Index n, const std::vector<bool> &ls, Index l, Index r)
+            {
+                Index end_l = l + 1, end_r = r + 1;
+                while (end_l < n && !lms(ls, end_l))
+                    end_l++;
+                while (end_r < n && !lms(ls, end_r))
+                    end_r++;
+                if (end_l - l != end_r - r)
+                    return false;
+                while (l < end_l && s[l] == s[r]) {
+                    l++;
+                    r++;
+                }
+                return l != n && r != n && s[l] == s[r];
+            }
+
+            // induce the order of all suffixes from the LMS suffixes placed
+            // in order at the ends of their buckets
+            template <typename T, typename Index>
+            void static induce(const T *s, Index *sa, Index n, const std::vector<bool> &ls, std::vector<Index> &bucket)
+            {
+                buckets(s, n, bucket, false);
+                sa[bucket[s[n - 1]]++] = n - 1;
+                for (Index i = 0; i < n; i++) {
+                    const Index v = sa[i];
+                    if (v >= 1 && !ls[v - 1])
+                        sa[bucket[s[v - 1]]++] = v - 1;
+                }
+
+                buckets(s, n, bucket, true);
+                for (Index i = n - 1; i >= 0; i--) {
+                    const Index v = sa[i];
+                    if (v >= 1 && ls[v - 1])
+                        sa[--bucket[s[v - 1]]] = v - 1;
+                }
+            }
+
+            template <typename T, typename Index>
+            void static naive(const T *s, Index *sa, Index n)
+            {
+                for (Index i = 0; i < n; i++)
+                    sa[i] = i;
+                std::sort(sa, sa + n, [s, n](Index l, Index r) {
+                    if (l == r)
+                        return false;
+                    while (l < n && r < n) {
+                        if (s[l] != s[r])
+                            return s[l] < s[r];
+                        l++;
+                        r++;
+                    }
+                    return l == n;
+                });
+            }
+    };
+}
+#endif
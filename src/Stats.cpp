@@ -0,0 +1,86 @@
+#include "Stats.h"
+
+namespace
+{
+    const char *const STAGE_NAMES[bw::Stats::STAGES] = {
+        "read", "suffix-sort", "bwt", "fm-index", "mtf-encode", "zero-runs-encode", "huffman-encode",
+        "huffman-decode", "rans-encode", "rans-decode", "zero-runs-decode", "mtf-decode", "bwt-inverse",
+        "checksum", "write"
+    };
+
+    const char *const COUNTER_NAMES[bw::Stats::COUNTERS] = {
+        "blocks", "symbols", "quick3-sorts", "quick3-comparisons"
+    };
+
+    const char *const PEAK_NAMES[bw::Stats::PEAKS] = {
+        "quick3-depth", "block-buffer", "packed-buffer", "in-flight"
+    };
+
+    double megabytesPerSecond(std::uint64_t bytes, std::uint64_t nanoseconds)
+    {
+        return nanoseconds ? bytes * 1e3 / nanoseconds : 0;
+    }
+}
+
+bw::Stats::Totals bw::Stats::stages[bw::Stats::STAGES];
+std::atomic<std::uint64_t> bw::Stats::counters[bw::Stats::COUNTERS];
+std::atomic<std::uint64_t> bw::Stats::peaks[bw::Stats::PEAKS];
+
+void bw::Stats::reset()
+{
+    for (Totals &t : stages) {
+        t.calls = 0;
+        t.nanoseconds = 0;
+        t.in = 0;
+        t.out = 0;
+    }
+    for (std::atomic<std::uint64_t> &c : counters)
+        c = 0;
+    for (std::atomic<std::uint64_t> &p : peaks)
+        p = 0;
+}
+
+void bw::Stats::report(std::FILE *out, bool json, double seconds)
+{
+    if (json) {
+        std::fprintf(out, "{\"enabled\": %s, \"seconds\": %.6f, \"stages\": {", enabled() ? "true" : "false", seconds);
+        for (unsigned s = 0; s < STAGES; s++) {
+            const Totals &t = stages[s];
+            std::fprintf(out, "%s\n  \"%s\": {\"calls\": %llu, \"seconds\": %.6f, \"in\": %llu, \"out\": %llu}",
+                    s ? "," : "", STAGE_NAMES[s], (unsigned long long) t.calls.load(), t.nanoseconds.load() / 1e9,
+                    (unsigned long long) t.in.load(), (unsigned long long) t.out.load());
+        }
+        std::fprintf(out, "},\n \"counters\": {");
+        for (unsigned c = 0; c < COUNTERS; c++)
+            std::fprintf(out, "%s\"%s\": %llu", c ? ", " : "", COUNTER_NAMES[c], (unsigned long long) counters[c].load());
+        std::fprintf(out, "},\n \"peaks\": {");
+        for (unsigned p = 0; p < PEAKS; p++)
+            std::fprintf(out, "%s\"%s\": %llu", p ? ", " : "", PEAK_NAMES[p], (unsigned long long) peaks[p].load());
+        std::fprintf(out, "}}\n");
+        return;
+    }
+
+    if (!enabled()) {
+        std::fprintf(out, "statistics not recorded: built without BW_STATS\n");
+        return;
+    }
+
+    // stage times add up over worker threads, so they may exceed the wall time
+    std::fprintf(out, "%-18s %8s %10s %14s %14s %10s\n", "stage", "calls", "seconds", "in", "out", "MB/s");
+    for (unsigned s = 0; s < STAGES; s++) {
+        const Totals &t = stages[s];
+        if (t.calls == 0)
+            continue;
+        std::fprintf(out, "%-18s %8llu %10.3f %14llu %14llu %10.2f\n", STAGE_NAMES[s],
+                (unsigned long long) t.calls.load(), t.nanoseconds.load() / 1e9,
+                (unsigned long long) t.in.load(), (unsigned long long) t.out.load(),
+                megabytesPerSecond(t.in, t.nanoseconds));
+    }
+    for (unsigned c = 0; c < COUNTERS; c++)
+        if (counters[c])
+            std::fprintf(out, "%-18s %llu\n", COUNTER_NAMES[c], (unsigned long long) counters[c].load());
+    for (unsigned p = 0; p < PEAKS; p++)
+        if (peaks[p])
+            std::fprintf(out, "%-18s %llu\n", PEAK_NAMES[p], (unsigned long long) peaks[p].load());
+    std::fprintf(out, "%-18s %.3f\n", "wall seconds", seconds);
+}
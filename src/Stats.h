@@ -0,0 +1,161 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+#include "Burrows-WheelerConfig.h"
+
+namespace bw
+{
+    // Process-wide figures of the pipeline for --stats: wall time, calls and
+    // bytes in and out of every stage, a few totals and peak sizes. Any thread
+    // may record; updates are relaxed atomics, so totals from concurrent jobs
+    // add up. The recording macros below compile to nothing unless the build
+    // has BW_STATS set, and the Quick3stringEx counters then cost nothing.
+    class Stats {
+        public:
+            enum Stage {
+                READ,               // input into blocks
+                SUFFIX_SORT,        // circular suffix array
+                BWT,                // last column and chain starts from the sorted rotations
+                FM_INDEX,           // FM-index sections from the sorted rotations
+                MTF_ENCODE,
+                ZERO_RUNS_ENCODE,
+                HUFFMAN_ENCODE,
+                HUFFMAN_DECODE,
+                RANS_ENCODE,
+                RANS_DECODE,
+                ZERO_RUNS_DECODE,
+                MTF_DECODE,
+                BWT_INVERSE,
+                CHECKSUM,           // CRC-32C of raw blocks
+                WRITE,              // blocks and index out
+                STAGES
+            };
+
+            enum Counter {
+                BLOCKS,             // blocks compressed or expanded
+                SYMBOLS,            // symbols through the entropy coders
+                QUICK3_SORTS,
+                QUICK3_COMPARISONS, // characters compared by Quick3stringEx
+                COUNTERS
+            };
+
+            enum Peak {
+                QUICK3_DEPTH,       // deepest Quick3stringEx recursion
+                BLOCK_BUFFER,       // largest raw block
+                PACKED_BUFFER,      // largest packed block
+                IN_FLIGHT,          // most blocks queued or being worked on at once
+                PEAKS
+            };
+
+        private:
+            struct Totals {
+                std::atomic<std::uint64_t> calls;
+                std::atomic<std::uint64_t> nanoseconds;
+                std::atomic<std::uint64_t> in;
+                std::atomic<std::uint64_t> out;
+            };
+
+            static Totals stages[STAGES];
+            static std::atomic<std::uint64_t> counters[COUNTERS];
+            static std::atomic<std::uint64_t> peaks[PEAKS];
+
+            // Do not instantiate.
+            Stats()
+            {
+            }
+
+        public:
+            // whether the build records anything
+            bool static enabled()
+            {
+                return BW_STATS != 0;
+            }
+
+            void static record(Stage stage, std::uint64_t nanoseconds, std::uint64_t in, std::uint64_t out)
+            {
+                Totals &t = stages[stage];
+                t.calls.fetch_add(1, std::memory_order_relaxed);
+                t.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+                t.in.fetch_add(in, std::memory_order_relaxed);
+                t.out.fetch_add(out, std::memory_order_relaxed);
+            }
+
+            void static add(Counter counter, std::uint64_t n)
+            {
+                counters[counter].fetch_add(n, std::memory_order_relaxed);
+            }
+
+            void static peak(Peak which, std::uint64_t n)
+            {
+                std::atomic<std::uint64_t> &p = peaks[which];
+                std::uint64_t seen = p.load(std::memory_order_relaxed);
+                while (seen < n && !p.compare_exchange_weak(seen, n, std::memory_order_relaxed))
+                    ;
+            }
+
+            void static reset();
+
+            // print everything recorded, as a table or as one JSON object;
+            // seconds is the wall time of the whole job
+            void static report(std::FILE *out, bool json, double seconds);
+
+            // times its scope as one call of a stage
+            class Timer {
+                private:
+                    Stage stage;
+                    std::uint64_t in, out;
+                    std::chrono::steady_clock::time_point start;
+
+                public:
+                    Timer(const Timer &that)=delete;
+                    Timer &operator=(const Timer &that)=delete;
+
+                    Timer(Stage _stage, std::uint64_t _in)
+                        :stage(_stage), in(_in), out(0), start(std::chrono::steady_clock::now())
+                    {
+                    }
+
+                    void input(std::uint64_t n)
+                    {
+                        in = n;
+                    }
+
+                    void output(std::uint64_t n)
+                    {
+                        out = n;
+                    }
+
+                    ~Timer()
+                    {
+                        const auto d = std::chrono::steady_clock::now() - start;
+                        record(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(d).count(), in, out);
+                    }
+            };
+    };
+}
+
+#if BW_STATS
+// time the rest of the scope as a call of stage taking `in` bytes
+#define BW_STATS_TIMER(name, stage, in) bw::Stats::Timer name(bw::Stats::stage, (in))
+// bytes in and out of the stage timed by name, when only known at the end
+#define BW_STATS_INPUT(name, n) name.input(n)
+#define BW_STATS_OUTPUT(name, n) name.output(n)
+#define BW_STATS_ADD(counter, n) bw::Stats::add(bw::Stats::counter, (n))
+#define BW_STATS_PEAK(which, n) bw::Stats::peak(bw::Stats::which, (n))
+// a statement that only exists in builds with statistics
+#define BW_STATS_ONLY(statement) statement
+#else
+#define BW_STATS_TIMER(name, stage, in)
+#define BW_STATS_INPUT(name, n)
+#define BW_STATS_OUTPUT(name, n)
+#define BW_STATS_ADD(counter, n)
+#define BW_STATS_PEAK(which, n)
+#define BW_STATS_ONLY(statement)
+#endif
+
+#endif
@@ -0,0 +1,186 @@
+#include "StreamCompressor.h"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include "BurrowsWheeler.h"
+#include "Huffman.h"
+#include "Crc32c.h"
+
+namespace
+{
+    // hand out[pos..) to data[0..n), releasing the buffer once it is empty
+    std::size_t take(std::string &out, std::size_t &pos, char *data, std::size_t n)
+    {
+        const std::size_t k = std::min(n, out.size() - pos);
+        std::memcpy(data, out.data() + pos, k);
+        pos += k;
+        if (pos == out.size()) {
+            out.clear();
+            pos = 0;
+        }
+        return k;
+    }
+}
+
+bw::StreamCompressor::StreamCompressor(std::size_t _blockSize, bool _zeroRuns, Compressor::Coder _coder,
+        unsigned _streams)
+    :blockSize(_blockSize)
+    ,zeroRuns(_zeroRuns)
+    ,coder(_coder)
+    ,streams(_streams)
+    ,out(Compressor::header(_blockSize))
+    ,outPos(0)
+    ,crc(0)
+    ,finishing(false)
+{
+    if (blockSize < BurrowsWheeler::MIN_BLOCK_SIZE || blockSize > BurrowsWheeler::MAX_BLOCK_SIZE)
+        throw std::invalid_argument("Block size out of range");
+    if (streams == 0 || streams > Huffman::MAX_STREAMS)
+        throw std::invalid_argument("Stream count out of range");
+    block.reserve(blockSize);
+}
+
+std::size_t bw::StreamCompressor::feed(const char *data, std::size_t n)
+{
+    if (finishing)
+        throw std::logic_error("Input fed after finish()");
+
+    std::size_t taken = 0;
+    while (taken < n && pending() == 0) {
+        const std::size_t k = std::min(n - taken, blockSize - block.size());
+        block.append(data + taken, k);
+        taken += k;
+        if (block.size() == blockSize)
+            compressBlock();
+    }
+    return taken;
+}
+
+std::size_t bw::StreamCompressor::drain(char *data, std::size_t n)
+{
+    return take(out, outPos, data, n);
+}
+
+void bw::StreamCompressor::flush()
+{
+    if (!block.empty())
+        compressBlock();
+}
+
+void bw::StreamCompressor::finish()
+{
+    if (finishing)
+        return;
+    flush();
+    const std::uint32_t end = 0;
+    out.append(reinterpret_cast<const char *>(&end), sizeof(end));
+    out.append(reinterpret_cast<const char *>(&crc), sizeof(crc));
+    finishing = true;
+}
+
+// append the framed block to the output and start a new one
+void bw::StreamCompressor::compressBlock()
+{
+    std::string packed;
+    Compressor::compressBlock(block, packed, zeroRuns, coder, streams);
+    crc = Crc32c::combine(crc, Compressor::blockChecksum(packed.data(), packed.size()), block.size());
+
+    const std::uint32_t rawSize = block.size(), packedSize = packed.size();
+    out.append(reinterpret_cast<const char *>(&rawSize), sizeof(rawSize));
+    out.append(reinterpret_cast<const char *>(&packedSize), sizeof(packedSize));
+    out.append(packed);
+    block.clear();
+}
+
+bw::StreamDecompressor::StreamDecompressor()
+    :state(HEADER)
+    ,need(Compressor::HEADER_SIZE)
+    ,rawSize(0)
+    ,crc(0)
+    ,outPos(0)
+{
+}
+
+std::size_t bw::StreamDecompressor::feed(const char *data, std::size_t n)
+{
+    std::size_t taken = 0;
+    while (taken < n && pending() == 0) {
+        if (state == END)
+            return n;
+        const std::size_t k = std::min(n - taken, need - in.size());
+        in.append(data + taken, k);
+        taken += k;
+        if (in.size() == need)
+            advance();
+    }
+    return taken;
+}
+
+std::size_t bw::StreamDecompressor::drain(char *data, std::size_t n)
+{
+    return take(out, outPos, data, n);
+}
+
+void bw::StreamDecompressor::finish() const
+{
+    if (state != END)
+        throw std::runtime_error("Truncated stream");
+}
+
+// act on a complete header or block and set up what comes next
+void bw::StreamDecompressor::advance()
+{
+    switch (state) {
+        case HEADER:
+            Compressor::checkHeader(in.data(), in.size());
+            state = RAW_SIZE;
+            need = sizeof(rawSize);
+            break;
+
+        // a zero raw size is the end marker, followed by the stream checksum
+        case RAW_SIZE:
+            std::memcpy(&rawSize, in.data(), sizeof(rawSize));
+            if (rawSize > BurrowsWheeler::MAX_BLOCK_SIZE)
+                throw std::runtime_error("Corrupted block header");
+            state = rawSize ? PACKED_SIZE : CHECKSUM;
+            need = sizeof(std::uint32_t);
+            break;
+
+        case PACKED_SIZE: {
+            std::uint32_t packedSize;
+            std::memcpy(&packedSize, in.data(), sizeof(packedSize));
+            if (packedSize > Compressor::MAX_PACKED_SIZE)
+                throw std::runtime_error("Corrupted block header");
+            state = BLOCK;
+            need = packedSize;
+            break;
+        }
+
+        case BLOCK:
+            Compressor::expandBlock(in, out);
+            if (out.size() != rawSize)
+                throw std::runtime_error("Corrupted block");
+            crc = Crc32c::combine(crc, Compressor::blockChecksum(in.data(), in.size()), rawSize);
+            state = RAW_SIZE;
+            need = sizeof(rawSize);
+            break;
+
+        case CHECKSUM: {
+            std::uint32_t expected;
+            std::memcpy(&expected, in.data(), sizeof(expected));
+            if (expected != crc)
+                throw std::runtime_error("Stream checksum mismatch");
+            state = END;
+            need = 0;
+            break;
+        }
+
+        case END:
+            break;
+    }
+    in.clear();
+    if (state == BLOCK && need == 0)
+        advance();
+}
@@ -0,0 +1,107 @@
+#ifndef _STREAMCOMPRESSOR_H_
+#define _STREAMCOMPRESSOR_H_
+
+#include <string>
+#include <cstdint>
+
+#include "Compressor.h"
+
+namespace bw
+{
+    // Incremental compression into the block container, for input that
+    // arrives in pieces (e.g. from a socket). Input is gathered up to one
+    // block; a full block is compressed on the spot and its output must be
+    // drained before more input is accepted, so memory stays bounded by the
+    // block size however long the stream is. Output starts at the latest
+    // after one block of input, or right away after flush().
+    //
+    // The stream carries no block index; it ends with the end marker and is
+    // read back by StreamDecompressor or by Compressor::expand.
+    class StreamCompressor {
+        private:
+            std::size_t blockSize;
+            bool zeroRuns;
+            Compressor::Coder coder;
+            unsigned streams;
+            std::string block;      // input of the current block
+            std::string out;        // compressed bytes not drained yet
+            std::size_t outPos;
+            std::uint32_t crc;      // checksum of the stream so far
+            bool finishing;
+
+        public:
+            StreamCompressor(const StreamCompressor &that)=delete;
+            StreamCompressor &operator=(const StreamCompressor &that)=delete;
+
+            StreamCompressor(std::size_t _blockSize = Compressor::DEFAULT_BLOCK_SIZE, bool _zeroRuns = true,
+                    Compressor::Coder _coder = Compressor::HUFFMAN, unsigned _streams = Compressor::DEFAULT_STREAMS);
+
+            // take up to n bytes of input; returns how many were taken, which is
+            // less than n while compressed output waits to be drained
+            std::size_t feed(const char *data, std::size_t n);
+
+            // copy up to n bytes of compressed output; returns how many were copied
+            std::size_t drain(char *data, std::size_t n);
+
+            // compress the input taken so far as a (short) block of its own
+            void flush();
+
+            // no more input: compress what is left and append the end marker
+            // and the stream checksum
+            void finish();
+
+            // bytes of compressed output waiting to be drained
+            std::size_t pending() const { return out.size() - outPos; }
+
+            // finish() was called and everything has been drained
+            bool finished() const { return finishing && pending() == 0; }
+
+        private:
+            void compressBlock();
+    };
+
+    // Incremental decompression of the block container. Input is gathered up
+    // to one packed block, which is expanded as soon as it is complete; its
+    // output must be drained before more input is accepted. Anything after the
+    // end marker, such as a block index, is ignored.
+    class StreamDecompressor {
+        private:
+            enum State { HEADER, RAW_SIZE, PACKED_SIZE, BLOCK, CHECKSUM, END };
+
+            State state;
+            std::string in;         // bytes of the current header or block
+            std::size_t need;       // size in bytes of what is being gathered
+            std::uint32_t rawSize;
+            std::uint32_t crc;      // checksum of the blocks so far
+            std::string out;        // expanded bytes not drained yet
+            std::size_t outPos;
+
+        public:
+            StreamDecompressor(const StreamDecompressor &that)=delete;
+            StreamDecompressor &operator=(const StreamDecompressor &that)=delete;
+
+            StreamDecompressor();
+
+            // take up to n bytes of input; returns how many were taken, which is
+            // less than n while expanded output waits to be drained
+            std::size_t feed(const char *data, std::size_t n);
+
+            // copy up to n bytes of expanded output; returns how many were copied
+            std::size_t drain(char *data, std::size_t n);
+
+            // no more input: throws unless the stream was complete
+            void finish() const;
+
+            // bytes of expanded output waiting to be drained
+            std::size_t pending() const { return out.size() - outPos; }
+
+            // the end marker and a matching stream checksum were read and
+            // everything has been drained
+            bool finished() const { return state == END && pending() == 0; }
+
+        private:
+            void advance();
+    };
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+namespace bw
+{
+    // Fixed set of worker threads consuming a FIFO of tasks.
+    class ThreadPool {
+        private:
+            std::vector<std::thread> workers;
+            std::queue<std::function<void()>> tasks;
+            std::mutex mutex;
+            std::condition_variable cv;
+            bool stopping;
+
+        public:
+            ThreadPool(const ThreadPool &pool)=delete;
+            ThreadPool &operator=(const ThreadPool &pool)=delete;
+
+            explicit ThreadPool(unsigned threads)
+                :stopping(false)
+            {
+                if (threads == 0)
+                    threads = 1;
+                for (unsigned i = 0; i < threads; i++)
+                    workers.emplace_back([this] { run(); });
+            }
+
+            ~ThreadPool()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopping = true;
+                }
+                cv.notify_all();
+                for (auto &worker: workers)
+                    worker.join();
+            }
+
+            unsigned size() const
+            {
+                return workers.size();
+            }
+
+            // number of threads the hardware runs concurrently, at least 1
+            static unsigned hardwareThreads()
+            {
+                const unsigned n = std::thread::hardware_concurrency();
+                return n ? n : 1;
+            }
+
+            // queue f; its result (or exception) is delivered through the future
+            template <typename F>
+            std::future<typename std::result_of<F()>::type> submit(F f)
+            {
+                typedef typename std::result_of<F()>::type R;
+                std::shared_ptr<std::packaged_task<R()>> task(new std::packaged_task<R()>(std::move(f)));
+                std::future<R> ret = task->get_future();
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    tasks.emplace([task] { (*task)(); });
+                }
+                cv.notify_one();
+                return ret;
+            }
+
+        private:
+            void run()
+            {
+                for (;;) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+                        if (tasks.empty())
+                            return;
+                        task = std::move(tasks.front());
+                        tasks.pop();
+                    }
+                    task();
+                }
+            }
+    };
+}
+
+#endif
@@ -0,0 +1,5 @@
+#include "ZeroRunLength.h"
+
+const std::uint16_t bw::ZeroRunLength::RUNA;
+const std::uint16_t bw::ZeroRunLength::RUNB;
+const unsigned bw::ZeroRunLength::SYMBOLS;
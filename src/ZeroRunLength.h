@@ -0,0 +1,106 @@
+#ifndef _ZERORUNLENGTH_H_
+#define _ZERORUNLENGTH_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+#include "Stats.h"
+
+namespace bw
+{
+    // Zero run-length coding of move-to-front output, as in bzip2. A run of
+    // zeros is written as its length in bijective base 2 with the digits
+    // RUNA (1) and RUNB (2), least significant first; every other byte v is
+    // shifted up to v + 1, so the alphabet has SYMBOLS = 257 symbols.
+    class ZeroRunLength {
+        public:
+            static const std::uint16_t RUNA = 0;
+            static const std::uint16_t RUNB = 1;
+            static const unsigned SYMBOLS = 257;
+
+        private:
+            // Do not instantiate.
+            ZeroRunLength()
+            {
+            }
+
+        public:
+            // encode in[0..n) into out
+            void static encode(const unsigned char *in, std::size_t n, std::vector<std::uint16_t> &out)
+            {
+                BW_STATS_TIMER(timer, ZERO_RUNS_ENCODE, n);
+                out.clear();
+                out.reserve(n / 2 + 16);
+
+                std::size_t run = 0;
+                for (std::size_t i = 0; i < n; i++) {
+                    const unsigned char c = in[i];
+                    if (c == 0) {
+                        run++;
+                        continue;
+                    }
+                    if (run) {
+                        writeRun(run, out);
+                        run = 0;
+                    }
+                    out.push_back(c + 1);
+                }
+                if (run)
+                    writeRun(run, out);
+                BW_STATS_OUTPUT(timer, out.size());
+            }
+
+            // decode in[0..n) into out, which may not grow beyond limit bytes
+            void static decode(const std::uint16_t *in, std::size_t n, std::string &out, std::size_t limit)
+            {
+                BW_STATS_TIMER(timer, ZERO_RUNS_DECODE, n);
+                out.clear();
+
+                std::size_t run = 0, weight = 1;
+                for (std::size_t i = 0; i < n; i++) {
+                    const std::uint16_t s = in[i];
+                    if (s <= RUNB) {
+                        // a run longer than limit is corrupt long before weight overflows
+                        if (weight > limit)
+                            throw std::runtime_error("Corrupted zero run");
+                        run += (s + 1) * weight;
+                        weight <<= 1;
+                        continue;
+                    }
+                    if (run) {
+                        flushRun(run, out, limit);
+                        run = 0;
+                        weight = 1;
+                    }
+                    if (s >= SYMBOLS || out.size() >= limit)
+                        throw std::runtime_error("Corrupted zero run");
+                    out.push_back(char(s - 1));
+                }
+                if (run)
+                    flushRun(run, out, limit);
+                BW_STATS_OUTPUT(timer, out.size());
+            }
+
+        private:
+            void static writeRun(std::size_t run, std::vector<std::uint16_t> &out)
+            {
+                // digits of run in bijective base 2
+                for (run--; ; run = (run - 2) >> 1) {
+                    out.push_back(run & 1 ? RUNB : RUNA);
+                    if (run < 2)
+                        break;
+                }
+            }
+
+            void static flushRun(std::size_t run, std::string &out, std::size_t limit)
+            {
+                if (run > limit - out.size())
+                    throw std::runtime_error("Corrupted zero run");
+                out.append(run, '\0');
+            }
+    };
+}
+
+#endif
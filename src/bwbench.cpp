@@ -0,0 +1,489 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <getopt.h>
+
+#include "shared.h"
+#include "Quick3stringEx.h"
+#include "CircularSuffixArray.h"
+#include "BurrowsWheeler.h"
+#include "MoveToFront.h"
+#include "ZeroRunLength.h"
+#include "Huffman.h"
+#include "Rans.h"
+#include "BitWriter.h"
+#include "BitReader.h"
+#include "Compressor.h"
+
+// Throughput of each stage of the pipeline, and of the whole pipeline, over
+// a small corpus. Stages run on the first block of every input, the pipeline
+// on the whole input; each figure is the best of several runs. Throughput is
+// always counted in uncompressed bytes, so stages compare directly.
+
+namespace
+{
+    const size_t ERROR_IN_COMMAND_LINE = 1;
+    const size_t SUCCESS = 0;
+    const size_t ERROR_UNHANDLED_EXCEPTION = 2;
+
+    // 3-way radix quicksort degrades on long repeats; it is timed on a prefix
+    const std::size_t QUICK3_LIMIT = 256 << 10;
+    // most runs of each measurement
+    const unsigned MAX_RUNS = 1000;
+
+    enum Format { TEXT, JSON, CSV };
+
+    struct Result {
+        std::string input;
+        std::string stage;
+        std::size_t bytes;      // uncompressed bytes of one run
+        std::size_t out;        // output bytes (symbols after zero runs) of one run
+        double seconds;         // best run
+    };
+
+    struct Input {
+        std::string name;
+        std::string data;
+    };
+
+    // best wall time of runs calls of f
+    double best(unsigned runs, const std::function<void()> &f)
+    {
+        double t = 1e300;
+        for (unsigned r = 0; r < runs; r++) {
+            const auto start = std::chrono::steady_clock::now();
+            f();
+            const std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+            t = std::min(t, d.count());
+        }
+        return t;
+    }
+
+    // Synthetic inputs; fixed seeds keep them identical between runs and releases.
+
+    std::string randomBytes(std::size_t n)
+    {
+        std::mt19937 rng(1);
+        std::string s(n, '\0');
+        for (std::size_t i = 0; i < n; i++)
+            s[i] = char(rng());
+        return s;
+    }
+
+    // a short phrase over and over, with a rare substitution
+    std::string repetitive(std::size_t n)
+    {
+        static const char phrase[] = "the quick brown fox jumps over the lazy dog; ";
+        std::mt19937 rng(2);
+        std::string s(n, '\0');
+        for (std::size_t i = 0; i < n; i++)
+            s[i] = phrase[i % (sizeof(phrase) - 1)];
+        for (std::size_t i = 0; i < n / 4096; i++)
+            s[rng() % n] = 'a' + rng() % 26;
+        return s;
+    }
+
+    // four letters with copies of earlier stretches, some reverse complemented
+    std::string dna(std::size_t n)
+    {
+        static const char base[] = "ACGT";
+        std::mt19937 rng(3);
+        std::string s;
+        s.reserve(n);
+        while (s.size() < n) {
+            const std::size_t len = std::min<std::size_t>(n - s.size(), 50 + rng() % 500);
+            if (s.size() > 10000 && rng() % 3 == 0) {
+                const std::size_t from = rng() % (s.size() - len);
+                if (rng() % 2)
+                    s.append(s, from, len);
+                else
+                    for (std::size_t i = 0; i < len; i++) {
+                        const char c = s[from + len - 1 - i];
+                        s.push_back(c == 'A' ? 'T' : c == 'C' ? 'G' : c == 'G' ? 'C' : 'A');
+                    }
+                // point mutations
+                for (std::size_t i = 0; i < len / 100; i++)
+                    s[s.size() - 1 - rng() % len] = base[rng() % 4];
+            }
+            else
+                for (std::size_t i = 0; i < len; i++)
+                    s.push_back(base[rng() % 4]);
+        }
+        return s;
+    }
+
+    // fixed-size little-endian records: rising timestamp, few sources and
+    // event types, a skewed value and a zero padded tag
+    std::string binaryLog(std::size_t n)
+    {
+        std::mt19937 rng(4);
+        std::geometric_distribution<std::uint32_t> skew(0.01);
+        std::string s;
+        s.reserve(n + 32);
+        std::uint64_t time = 1500000000000ull;
+        while (s.size() < n) {
+            char record[32] = {0};
+            time += rng() % 1000;
+            const std::uint16_t source = rng() % 24, type = rng() % 7;
+            const std::uint32_t value = skew(rng);
+            std::memcpy(record, &time, sizeof(time));
+            std::memcpy(record + 8, &source, sizeof(source));
+            std::memcpy(record + 10, &type, sizeof(type));
+            std::memcpy(record + 12, &value, sizeof(value));
+            std::snprintf(record + 16, 16, "evt%u", unsigned(type * 100 + source));
+            s.append(record, sizeof(record));
+        }
+        s.resize(n);
+        return s;
+    }
+
+    bool readFile(const std::string &path, std::string &data)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return false;
+        data.assign(std::istreambuf_iterator<char>(in), {});
+        return true;
+    }
+
+    std::string baseName(const std::string &path)
+    {
+        const std::size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+    // time every stage on the first block of input and the pipeline on all of it
+    void run(const Input &input, std::size_t blockSize, unsigned threads, unsigned runs,
+            std::vector<Result> &results)
+    {
+        const std::string block = input.data.substr(0, blockSize);
+        const std::size_t n = block.size();
+        auto add = [&](const char *stage, std::size_t bytes, std::size_t out, double seconds) {
+            results.push_back(Result{input.name, stage, bytes, out, seconds});
+        };
+
+        add("suffix-sais", n, 0, best(runs, [&]{
+            bw::CircularSuffixArray cas(block.data(), n, bw::CircularSuffixArray::SAIS);
+        }));
+        add("suffix-parallel", n, 0, best(runs, [&]{
+            bw::CircularSuffixArray cas(block.data(), n, bw::CircularSuffixArray::PARALLEL, threads);
+        }));
+
+        // same setup as CircularSuffixArray: offsets into the doubled string
+        const std::size_t m = std::min(n, QUICK3_LIMIT);
+        const std::string doubled = block.substr(0, m) + block.substr(0, m);
+        add("quick3-sort", m, 0, best(runs, [&]{
+            std::vector<std::uint32_t> idx(m);
+            std::iota(idx.begin(), idx.end(), 0);
+            bw::Quick3stringEx::sort(idx, doubled);
+        }));
+
+        std::string bwt;
+        std::vector<std::uint64_t> starts;
+        add("bwt-forward", n, n, best(runs, [&]{
+            bw::BurrowsWheeler::transform(block, bwt, starts, bw::BurrowsWheeler::MAX_CHAINS);
+        }));
+
+        std::string mtf(n, '\0');
+        add("mtf-encode", n, n, best(runs, [&]{
+            bw::MoveToFront::encode(reinterpret_cast<const unsigned char *>(bwt.data()), n,
+                    reinterpret_cast<unsigned char *>(&mtf[0]));
+        }));
+
+        std::vector<std::uint16_t> zrle;
+        add("zrle-encode", n, 0, best(runs, [&]{
+            bw::ZeroRunLength::encode(reinterpret_cast<const unsigned char *>(mtf.data()), n, zrle);
+        }));
+        results.back().out = zrle.size();
+
+        std::string packed;
+        add("huffman-compress", n, 0, best(runs, [&]{
+            packed.clear();
+            bw::BitWriter out(packed);
+            bw::Huffman::compressTables(zrle.data(), zrle.size(), bw::ZeroRunLength::SYMBOLS, out);
+            out.flush();
+        }));
+        results.back().out = packed.size();
+
+        std::vector<std::uint16_t> zrleBack;
+        add("huffman-expand", n, 0, best(runs, [&]{
+            bw::BitReader in(packed.data(), packed.size());
+            bw::Huffman::expandTables(in, zrleBack, bw::ZeroRunLength::SYMBOLS, zrle.size());
+        }));
+        results.back().out = zrleBack.size();
+
+        std::string streamsPacked;
+        add("huffman-streams-compress", n, 0, best(runs, [&]{
+            streamsPacked.clear();
+            bw::BitWriter out(streamsPacked);
+            bw::Huffman::compressStreams(zrle.data(), zrle.size(), bw::ZeroRunLength::SYMBOLS,
+                    bw::Compressor::DEFAULT_STREAMS, out);
+            out.flush();
+        }));
+        results.back().out = streamsPacked.size();
+
+        std::vector<std::uint16_t> streamsBack;
+        add("huffman-streams-expand", n, 0, best(runs, [&]{
+            bw::Huffman::expandStreams(reinterpret_cast<const unsigned char *>(streamsPacked.data()),
+                    streamsPacked.size(), streamsBack, bw::ZeroRunLength::SYMBOLS, n);
+        }));
+        results.back().out = streamsBack.size();
+        if (streamsBack != zrle)
+            throw std::runtime_error("Huffman streams round trip failed on " + input.name);
+
+        std::string ransPacked;
+        add("rans-compress", n, 0, best(runs, [&]{
+            ransPacked.clear();
+            bw::Rans::compress(zrle.data(), zrle.size(), bw::ZeroRunLength::SYMBOLS, ransPacked);
+        }));
+        results.back().out = ransPacked.size();
+
+        std::vector<std::uint16_t> ransBack;
+        add("rans-expand", n, 0, best(runs, [&]{
+            bw::Rans::expand(reinterpret_cast<const unsigned char *>(ransPacked.data()), ransPacked.size(),
+                    ransBack, bw::ZeroRunLength::SYMBOLS, n);
+        }));
+        results.back().out = ransBack.size();
+        if (ransBack != zrle)
+            throw std::runtime_error("rANS round trip failed on " + input.name);
+
+        std::string mtfBack;
+        add("zrle-decode", n, n, best(runs, [&]{
+            bw::ZeroRunLength::decode(zrleBack.data(), zrleBack.size(), mtfBack, n);
+        }));
+
+        std::string bwtBack(n, '\0');
+        add("mtf-decode", n, n, best(runs, [&]{
+            bw::MoveToFront::decode(reinterpret_cast<const unsigned char *>(mtfBack.data()), n,
+                    reinterpret_cast<unsigned char *>(&bwtBack[0]));
+        }));
+
+        std::string blockBack;
+        add("bwt-inverse", n, n, best(runs, [&]{
+            bw::BurrowsWheeler::inverse(starts, bwtBack, blockBack);
+        }));
+        if (blockBack != block)
+            throw std::runtime_error("Stage round trip failed on " + input.name);
+
+        // bit I/O with fields of 1 to 16 bits taken from the input
+        std::string bits;
+        add("bitio-write", n, 0, best(runs, [&]{
+            bits.clear();
+            bw::BitWriter out(bits);
+            for (std::size_t i = 0; i < n; i++)
+                out.writeBits(static_cast<unsigned char>(block[i]), 1 + (i & 15));
+            out.flush();
+        }));
+        results.back().out = bits.size();
+
+        volatile std::uint64_t sum = 0;     // keeps the reads from being optimized away
+        add("bitio-read", n, 0, best(runs, [&]{
+            bw::BitReader in(bits.data(), bits.size());
+            std::uint64_t s = 0;
+            for (std::size_t i = 0; i < n; i++)
+                s += in.readBits(1 + (i & 15));
+            sum = s;
+        }));
+
+        // the whole pipeline through the buffer API
+        const bw::Compressor compressor(blockSize, threads);
+        std::vector<char> compressed(bw::Compressor::compressBound(input.data.size(), blockSize));
+        std::size_t csize = 0;
+        add("compress", input.data.size(), 0, best(runs, [&]{
+            csize = compressor.compress(input.data.data(), input.data.size(), &compressed[0], compressed.size());
+        }));
+        results.back().out = csize;
+
+        std::string expanded(input.data.size(), '\0');
+        add("expand", input.data.size(), input.data.size(), best(runs, [&]{
+            compressor.expand(&compressed[0], csize, &expanded[0], expanded.size());
+        }));
+        if (expanded != input.data)
+            throw std::runtime_error("Round trip failed on " + input.name);
+    }
+
+    // MB/s over the bytes each stage consumes
+    double mbps(const Result &r)
+    {
+        return r.seconds > 0 ? r.bytes / r.seconds / 1e6 : 0;
+    }
+
+    double nsPerByte(const Result &r)
+    {
+        return r.bytes ? r.seconds * 1e9 / r.bytes : 0;
+    }
+
+    // s as the body of a JSON string
+    std::string quoted(const std::string &s)
+    {
+        std::string q;
+        for (char c : s) {
+            if (c == '"' || c == '\\')
+                q.push_back('\\');
+            if (static_cast<unsigned char>(c) >= 0x20)
+                q.push_back(c);
+        }
+        return q;
+    }
+
+    void report(const std::vector<Result> &results, Format format)
+    {
+        if (format == JSON) {
+            std::printf("[\n");
+            for (std::size_t i = 0; i < results.size(); i++) {
+                const Result &r = results[i];
+                std::printf("  {\"input\": \"%s\", \"stage\": \"%s\", \"bytes\": %zu, \"out\": %zu, "
+                        "\"seconds\": %.6f, \"mb_per_s\": %.2f, \"ns_per_byte\": %.3f}%s\n",
+                        quoted(r.input).c_str(), r.stage.c_str(), r.bytes, r.out,
+                        r.seconds, mbps(r), nsPerByte(r), i + 1 < results.size() ? "," : "");
+            }
+            std::printf("]\n");
+        }
+        else if (format == CSV) {
+            std::printf("input,stage,bytes,out,seconds,mb_per_s,ns_per_byte\n");
+            for (const Result &r : results)
+                std::printf("%s,%s,%zu,%zu,%.6f,%.2f,%.3f\n", r.input.c_str(), r.stage.c_str(),
+                        r.bytes, r.out, r.seconds, mbps(r), nsPerByte(r));
+        }
+        else {
+            std::printf("%-14s %-24s %10s %10s %10s %10s\n", "input", "stage", "bytes", "out", "MB/s", "ns/byte");
+            for (const Result &r : results)
+                std::printf("%-14s %-24s %10zu %10zu %10.2f %10.3f\n", r.input.c_str(), r.stage.c_str(),
+                        r.bytes, r.out, mbps(r), nsPerByte(r));
+        }
+    }
+
+} // namespace
+
+void usage() {
+    std::fprintf(stderr, "-h/--help: Emit help menu\n"
+                         "-i/--input: Add a file to the corpus (repeatable; default test/mobydick.txt)\n"
+                         "-s/--size: Size of each synthetic input (default 2M)\n"
+                         "-b/--block-size: Block size (100k-64M, default 900k)\n"
+                         "-t/--threads: Worker threads of the pipeline and the parallel suffix sort (default: all cores)\n"
+                         "-r/--runs: Runs per measurement, the best is reported (default 3)\n"
+                         "-f/--format: text, json or csv (default text)\n");
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> files;
+    int option_index, c;
+    std::size_t size(2 << 20);
+    std::size_t block_size(bw::Compressor::DEFAULT_BLOCK_SIZE);
+    unsigned threads(0), runs(3);
+    Format format(TEXT);
+    static struct option long_options[] =
+        {
+          {"help",     no_argument,      0, 'h'},
+          {"input",   required_argument,     0, 'i'},
+          {"size",    required_argument,     0, 's'},
+          {"block-size", required_argument, 0, 'b'},
+          {"threads",  required_argument, 0, 't'},
+          {"runs",     required_argument, 0, 'r'},
+          {"format",   required_argument, 0, 'f'},
+          {0, 0, 0, 0}
+        };
+    while((c = getopt_long(argc, argv, "hi:s:b:t:r:f:", long_options, &option_index)) >= 0) {
+        switch(c) {
+            case 'i': files.push_back(optarg); break;
+            case 's':
+                size = bw::parseSize(optarg);
+                if (size == 0) {
+                    std::fprintf(stderr, "Invalid size '%s'\n", optarg);
+                    return ERROR_IN_COMMAND_LINE;
+                }
+                break;
+            case 'b':
+                block_size = bw::parseSize(optarg);
+                if (block_size < bw::BurrowsWheeler::MIN_BLOCK_SIZE || block_size > bw::BurrowsWheeler::MAX_BLOCK_SIZE) {
+                    std::fprintf(stderr, "Invalid block size '%s': expected 100k to 64M\n", optarg);
+                    return ERROR_IN_COMMAND_LINE;
+                }
+                break;
+            case 't': {
+                unsigned long long v;
+                if (!bw::parseCount(optarg, bw::MAX_THREADS, v)) {
+                    std::fprintf(stderr, "Invalid thread count '%s': expected 0 (all cores) to %u\n",
+                            optarg, bw::MAX_THREADS);
+                    return ERROR_IN_COMMAND_LINE;
+                }
+                threads = v;
+                break;
+            }
+            case 'r': {
+                unsigned long long v;
+                if (!bw::parseCount(optarg, MAX_RUNS, v) || v == 0) {
+                    std::fprintf(stderr, "Invalid number of runs '%s': expected 1 to %u\n", optarg, MAX_RUNS);
+                    return ERROR_IN_COMMAND_LINE;
+                }
+                runs = v;
+                break;
+            }
+            case 'f':
+                if (!std::strcmp(optarg, "json"))
+                    format = JSON;
+                else if (!std::strcmp(optarg, "csv"))
+                    format = CSV;
+                else if (!std::strcmp(optarg, "text"))
+                    format = TEXT;
+                else {
+                    std::fprintf(stderr, "Invalid format '%s': expected text, json or csv\n", optarg);
+                    return ERROR_IN_COMMAND_LINE;
+                }
+                break;
+            case 'h':
+            default:
+                std::cout << "Burrows-Wheeler benchmarks" << std::endl <<
+                    "Usage: " << basename(argv[0]) << " [-h] [-i file]... [-s size] [-b size] [-t threads] [-r runs] [-f format]" << std::endl;
+                usage();
+                return ERROR_IN_COMMAND_LINE;
+        }
+    }
+
+    try
+    {
+        std::vector<Input> corpus;
+        if (files.empty()) {
+            Input text{"mobydick.txt", std::string()};
+            if (readFile("test/mobydick.txt", text.data))
+                corpus.push_back(text);
+            else
+                std::fprintf(stderr, "%s: test/mobydick.txt not found, skipping text\n", basename(argv[0]));
+        }
+        for (const std::string &f : files) {
+            Input file{baseName(f), std::string()};
+            if (!readFile(f, file.data)) {
+                std::fprintf(stderr, "%s: cannot read '%s'\n", basename(argv[0]), f.c_str());
+                return ERROR_IN_COMMAND_LINE;
+            }
+            corpus.push_back(file);
+        }
+        corpus.push_back(Input{"random", randomBytes(size)});
+        corpus.push_back(Input{"repetitive", repetitive(size)});
+        corpus.push_back(Input{"dna", dna(size)});
+        corpus.push_back(Input{"binary-log", binaryLog(size)});
+
+        std::vector<Result> results;
+        for (const Input &input : corpus) {
+            if (format == TEXT)
+                std::fprintf(stderr, "%s: %zu bytes\n", input.name.c_str(), input.data.size());
+            run(input, block_size, threads, runs, results);
+        }
+        report(results, format);
+    }
+    catch (const std::exception &e)
+    {
+        std::fprintf(stderr, "%s: %s\n", basename(argv[0]), e.what());
+        return ERROR_UNHANDLED_EXCEPTION;
+    }
+
+    return SUCCESS;
+
+} // main
@@ -0,0 +1,101 @@
+#include "bwc.h"
+
+#include <new>
+#include <cstdint>
+#include <stdexcept>
+
+#include "Compressor.h"
+
+namespace
+{
+    // exceptions do not cross the C interface; only a full output buffer
+    // asks for a larger one, other length errors are the input's (oversized)
+    template <typename F>
+    int guard(F f, int malformed, int oversized)
+    {
+        try {
+            f();
+            return BWC_OK;
+        }
+        catch (const bw::OutputTooSmall &) {
+            return BWC_ERROR_DST_TOO_SMALL;
+        }
+        catch (const std::length_error &) {
+            return oversized;
+        }
+        catch (const std::invalid_argument &) {
+            return BWC_ERROR_PARAMETER;
+        }
+        catch (const std::bad_alloc &) {
+            return BWC_ERROR_MEMORY;
+        }
+        catch (const std::runtime_error &) {
+            return malformed;
+        }
+        catch (...) {
+            return BWC_ERROR_INTERNAL;
+        }
+    }
+}
+
+size_t bwc_compress_bound(size_t src_size, size_t block_size)
+{
+    return bw::Compressor::compressBound(src_size, block_size ? block_size : bw::Compressor::DEFAULT_BLOCK_SIZE);
+}
+
+int bwc_compress(const void *src, size_t src_size, void *dst, size_t dst_capacity, size_t *dst_size,
+        size_t block_size, unsigned threads)
+{
+    if ((src == NULL && src_size) || dst == NULL || dst_size == NULL)
+        return BWC_ERROR_PARAMETER;
+    return guard([&] {
+        const bw::Compressor compressor(block_size ? block_size : bw::Compressor::DEFAULT_BLOCK_SIZE, threads);
+        *dst_size = compressor.compress(src, src_size, dst, dst_capacity);
+    }, BWC_ERROR_INTERNAL, BWC_ERROR_PARAMETER);
+}
+
+int bwc_decompress(const void *src, size_t src_size, void *dst, size_t dst_capacity, size_t *dst_size,
+        unsigned threads)
+{
+    if ((src == NULL && src_size) || (dst == NULL && dst_capacity) || dst_size == NULL)
+        return BWC_ERROR_PARAMETER;
+    return guard([&] {
+        const bw::Compressor compressor(bw::Compressor::DEFAULT_BLOCK_SIZE, threads);
+        *dst_size = compressor.expand(src, src_size, dst, dst_capacity);
+    }, BWC_ERROR_CORRUPT, BWC_ERROR_CORRUPT);
+}
+
+int bwc_decompress_range(const void *src, size_t src_size, unsigned long long offset, unsigned long long length,
+        void *dst, size_t dst_capacity, size_t *dst_size, unsigned threads)
+{
+    if ((src == NULL && src_size) || (dst == NULL && dst_capacity) || dst_size == NULL)
+        return BWC_ERROR_PARAMETER;
+    return guard([&] {
+        const bw::Compressor compressor(bw::Compressor::DEFAULT_BLOCK_SIZE, threads);
+        *dst_size = compressor.expandRange(src, src_size, offset, length, dst, dst_capacity);
+    }, BWC_ERROR_CORRUPT, BWC_ERROR_CORRUPT);
+}
+
+int bwc_decompressed_size(const void *src, size_t src_size, unsigned long long *size)
+{
+    if ((src == NULL && src_size) || size == NULL)
+        return BWC_ERROR_PARAMETER;
+    return guard([&] {
+        std::uint64_t n;
+        if (!bw::Compressor::expandedSize(src, src_size, n))
+            throw std::runtime_error("No block index");
+        *size = n;
+    }, BWC_ERROR_CORRUPT, BWC_ERROR_CORRUPT);
+}
+
+const char *bwc_error_string(int status)
+{
+    switch (status) {
+        case BWC_OK: return "Success";
+        case BWC_ERROR_DST_TOO_SMALL: return "Output buffer too small";
+        case BWC_ERROR_CORRUPT: return "Corrupted or unsupported input";
+        case BWC_ERROR_PARAMETER: return "Invalid parameter";
+        case BWC_ERROR_MEMORY: return "Out of memory";
+        default: return "Internal error";
+    }
+}
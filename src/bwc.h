@@ -0,0 +1,58 @@
+#ifndef _BWC_H_
+#define _BWC_H_
+
+/*
+ * C interface of the block compressor (Burrows-Wheeler, move-to-front,
+ * zero runs and Huffman). Every call works on caller owned buffers and
+ * keeps no state between calls, so it is safe to use from many threads.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum bwc_status {
+    BWC_OK = 0,
+    BWC_ERROR_DST_TOO_SMALL = -1,   /* the output does not fit in dst_capacity */
+    BWC_ERROR_CORRUPT = -2,         /* the input is not a valid compressed stream */
+    BWC_ERROR_PARAMETER = -3,       /* invalid block size, null pointer or input too large */
+    BWC_ERROR_MEMORY = -4,          /* out of memory */
+    BWC_ERROR_INTERNAL = -5
+};
+
+/* dst_capacity that always holds the compressed form of src_size bytes */
+size_t bwc_compress_bound(size_t src_size, size_t block_size);
+
+/*
+ * Compress src[0..src_size) into dst; *dst_size receives the compressed size.
+ * block_size is 100k to 64M, or 0 for the default of 900k; threads is the
+ * number of worker threads, or 0 for all cores.
+ */
+int bwc_compress(const void *src, size_t src_size, void *dst, size_t dst_capacity, size_t *dst_size,
+        size_t block_size, unsigned threads);
+
+/* expand src[0..src_size) into dst; *dst_size receives the expanded size */
+int bwc_decompress(const void *src, size_t src_size, void *dst, size_t dst_capacity, size_t *dst_size,
+        unsigned threads);
+
+/*
+ * Expand only bytes [offset, offset + length) of the original data, clipped to
+ * its size. With a block index only the blocks overlapping the range are
+ * decoded, so the cost does not grow with the size of src.
+ */
+int bwc_decompress_range(const void *src, size_t src_size, unsigned long long offset, unsigned long long length,
+        void *dst, size_t dst_capacity, size_t *dst_size, unsigned threads);
+
+/* expanded size recorded in the block index of src; BWC_ERROR_CORRUPT if it has none */
+int bwc_decompressed_size(const void *src, size_t src_size, unsigned long long *size);
+
+/* description of a status code */
+const char *bwc_error_string(int status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
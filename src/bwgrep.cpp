@@ -0,0 +1,151 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+
+#include "shared.h"
+#include "FmIndex.h"
+
+// Search the FM-index of a compressed file (bw -c -x) for a fixed string and
+// print the lines that contain it, as grep -F would on the original data,
+// without expanding the compressed file.
+
+namespace
+{
+    const size_t ERROR_IN_COMMAND_LINE = 1;
+    const size_t SUCCESS = 0;
+    const size_t ERROR_UNHANDLED_EXCEPTION = 2;
+    // as for grep, nothing matched
+    const size_t NO_MATCH = 1;
+
+    // bytes extracted at a time while looking for the ends of a line
+    const std::size_t STEP = 128;
+    // lines are cut this far either side of a match, so that binary data stays cheap
+    const std::size_t MAX_LINE = 1 << 16;
+
+    // the line holding bytes [offset, offset + n), newline included, grown
+    // from them a few bytes at a time; returns the offset of its start
+    std::uint64_t line(const bw::FmIndex &index, std::uint64_t offset, std::size_t n, std::string &text)
+    {
+        text = index.extract(offset, n);
+        std::uint64_t start = offset;
+        const std::uint64_t low = offset > MAX_LINE ? offset - MAX_LINE : 0;
+        for (bool found = false; !found && start > low; ) {
+            const std::uint64_t from = start - std::min<std::uint64_t>(STEP, start - low);
+            std::string before = index.extract(from, start - from);
+            const std::size_t newline = before.rfind('\n');
+            found = newline != std::string::npos;
+            if (found)
+                before.erase(0, newline + 1);
+            text.insert(0, before);
+            start -= before.size();
+        }
+        const std::uint64_t high = std::min<std::uint64_t>(offset + n + MAX_LINE, index.size());
+        for (std::uint64_t end = offset + n; end < high; ) {
+            std::string after = index.extract(end, std::min<std::uint64_t>(STEP, high - end));
+            const std::size_t newline = after.find('\n');
+            if (newline != std::string::npos) {
+                text.append(after, 0, newline + 1);
+                break;
+            }
+            text += after;
+            end += after.size();
+        }
+        return start;
+    }
+}
+
+void usage() {
+    std::fprintf(stderr, "-h/--help: Emit help menu\n"
+                         "-c/--count: Print the number of occurrences instead of lines\n"
+                         "-o/--offsets: Print the byte offset of every occurrence instead of lines\n"
+                         "-b/--byte-offset: Prefix each line with the byte offset of its start\n"
+                         "-m/--max-count: Stop after this many lines\n");
+}
+
+int main(int argc, char** argv)
+{
+    int option_index, c;
+    bool count(false), offsets(false), byte_offset(false);
+    std::uint64_t max_count(UINT64_MAX);
+    static struct option long_options[] =
+        {
+          {"help",        no_argument,       0, 'h'},
+          {"count",       no_argument,       0, 'c'},
+          {"offsets",     no_argument,       0, 'o'},
+          {"byte-offset", no_argument,       0, 'b'},
+          {"max-count",   required_argument, 0, 'm'},
+          {0, 0, 0, 0}
+        };
+    while((c = getopt_long(argc, argv, "hcobm:", long_options, &option_index)) >= 0) {
+        switch(c) {
+            case 'c': count = true; break;
+            case 'o': offsets = true; break;
+            case 'b': byte_offset = true; break;
+            case 'm': {
+                unsigned long long v;
+                if (!bw::parseCount(optarg, UINT64_MAX, v)) {
+                    std::fprintf(stderr, "Invalid count '%s': expected a number of lines\n", optarg);
+                    return ERROR_IN_COMMAND_LINE;
+                }
+                max_count = v;
+                break;
+            }
+            case 'h':
+            default:
+                std::cout << "Search the FM-index of a compressed file for a fixed string" << std::endl <<
+                    "Usage: " << basename(argv[0]) << " [-h] [-c|-o] [-b] [-m num] pattern index" << std::endl;
+                usage();
+                std::exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - optind != 2 || argv[optind][0] == '\0') {
+        std::fprintf(stderr, "%s: expected a non-empty pattern and an index file\n", basename(argv[0]));
+        return ERROR_IN_COMMAND_LINE;
+    }
+    const std::string pattern(argv[optind]);
+
+    try
+    {
+        const bw::FmIndex index(argv[optind + 1]);
+        if (count) {
+            const std::uint64_t n = index.count(pattern);
+            std::printf("%llu\n", (unsigned long long) n);
+            return n ? SUCCESS : NO_MATCH;
+        }
+
+        std::vector<std::uint64_t> found;
+        index.locate(pattern, found);
+        std::uint64_t lines = 0, printed = 0;
+        for (std::size_t i = 0; i < found.size() && lines < max_count; i++) {
+            if (offsets) {
+                std::printf("%llu\n", (unsigned long long) found[i]);
+                lines++;
+                continue;
+            }
+            // one line for all the occurrences in it
+            if (found[i] < printed)
+                continue;
+            std::string text;
+            const std::uint64_t start = line(index, found[i], pattern.size(), text);
+            printed = start + text.size();
+            if (text.back() != '\n')
+                text += '\n';
+            if (byte_offset)
+                std::printf("%llu:", (unsigned long long) start);
+            std::fwrite(text.data(), 1, text.size(), stdout);
+            lines++;
+        }
+        return found.empty() ? NO_MATCH : SUCCESS;
+    }
+    catch (const std::exception &e)
+    {
+        std::fprintf(stderr, "%s: %s\n", basename(argv[0]), e.what());
+        return ERROR_UNHANDLED_EXCEPTION;
+    }
+
+} // main
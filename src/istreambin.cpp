@@ -78,3 +78,19 @@ bool bw::istreambin::read(std::string &s)
 //    }
     return false;
 }
+
+int bw::istreambin::readRemaining(std::string &s)
+{
+    s.clear();
+    if (bufferInEOF)
+        return 0;
+
+    const int consumed = 8 - bufferInBitSize;
+    s.push_back(bufferIn);
+    s.append(std::istreambuf_iterator<char>(*in_ptr), std::istreambuf_iterator<char>());
+
+    bufferInBitSize = -1;
+    bufferIn = 0;
+    bufferInEOF = true;
+    return consumed;
+}
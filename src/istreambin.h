@@ -35,6 +35,8 @@ namespace bw
             bool read(char &byte);
             bool read(char* s, const int len);
             bool read(std::string &s);
+            // move the unread input into s; returns how many leading bits of s are already consumed
+            int readRemaining(std::string &s);
             bool isEmpty();
     };
 }
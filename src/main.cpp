@@ -1,15 +1,182 @@
-#include "CircularSuffixArray.h"
 #include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <getopt.h>
+
+#include "shared.h"
+#include "BurrowsWheeler.h"
+#include "Compressor.h"
+#include "Huffman.h"
+#include "Stats.h"
+
+namespace
+{
+    const size_t ERROR_IN_COMMAND_LINE = 1;
+    const size_t SUCCESS = 0;
+    const size_t ERROR_UNHANDLED_EXCEPTION = 2;
+
+} // namespace
+
+void usage() {
+    std::fprintf(stderr, "-h/--help: Emit help menu\n"
+                         "-i/--input: Set input file\n"
+                         "-o/--output: Set output file\n"
+                         "-c/--compress: Compress (-e/--encode is an alias)\n"
+                         "-d/--decode: Decompress\n"
+                         "-T/--test: Check the integrity of compressed input without writing output\n"
+                         "-r/--range: Decompress only OFFSET:LENGTH of the original data (k/M/G suffixes)\n"
+                         "-b/--block-size: Block size (100k-64M, default 900k)\n"
+                         "-t/--threads: Number of worker threads (default: all cores)\n"
+                         "-n/--no-zero-runs: Skip the zero run-length stage between move-to-front and the entropy coder\n"
+                         "-E/--entropy: Entropy coder: huffman (default), rans, or auto for the shorter per block\n"
+                         "-I/--interleave: Huffman bitstreams per block, decoded side by side (1-8, default 4)\n"
+                         "-x/--fm-index: With -c, also write an FM-index of the data to this file, for bwgrep\n"
+                         "--stats[=json]: Print per-stage statistics to standard error\n");
+}
 
 int main(int argc, char** argv)
 {
-    bw::CircularSuffixArray c("ABRACADABRA!");
-    for (int i = 0; i < 12; i++)
+    std::string sif;
+    std::string sof;
+    std::string fm_index;
+    int option_index, c;
+    bool encode(false), decode(false), test(false), range(false);
+    std::uint64_t range_offset(0), range_length(0);
+    std::size_t block_size(bw::Compressor::DEFAULT_BLOCK_SIZE);
+    unsigned threads(0);
+    bool zero_runs(true);
+    bw::Compressor::Coder coder(bw::Compressor::HUFFMAN);
+    unsigned streams(bw::Compressor::DEFAULT_STREAMS);
+    bool stats(false), stats_json(false);
+    static struct option long_options[] =
+        {
+          /* These options don’t set a flag.
+             We distinguish them by their indices. */
+          {"help",     no_argument,      0, 'h'},
+          {"compress", no_argument,      0, 'c'},
+          {"encode",   no_argument,      0, 'e'},
+          {"decode",   no_argument,      0, 'd'},
+          {"test",     no_argument,      0, 'T'},
+          {"range",    required_argument, 0, 'r'},
+          {"output",   required_argument,     0, 'o'},
+          {"input",   required_argument,     0, 'i'},
+          {"block-size", required_argument, 0, 'b'},
+          {"threads",  required_argument, 0, 't'},
+          {"no-zero-runs", no_argument,   0, 'n'},
+          {"entropy",  required_argument, 0, 'E'},
+          {"interleave", required_argument, 0, 'I'},
+          {"fm-index", required_argument, 0, 'x'},
+          {"stats",    optional_argument, 0, 'S'},
+          {0, 0, 0, 0}
+        };
+    while((c = getopt_long(argc, argv, "i:o:hcedTr:b:t:nE:I:x:", long_options, &option_index)) >= 0) {
+        switch(c) {
+            case 'c':
+            case 'e': encode  = true; break;
+            case 'd': decode  = true; break;
+            case 'T': test    = true; break;
+            case 'r':
+                if (!bw::parseRange(optarg, range_offset, range_length)) {
+                    std::fprintf(stderr, "Invalid range '%s': expected OFFSET:LENGTH\n", optarg);
+                    std::exit(EXIT_FAILURE);
+                }
+                range = true;
+                break;
+            case 'i': sif     = optarg; break;
+            case 'o': sof     = optarg; break;
+            case 'b':
+                block_size = bw::parseSize(optarg);
+                if (block_size < bw::BurrowsWheeler::MIN_BLOCK_SIZE || block_size > bw::BurrowsWheeler::MAX_BLOCK_SIZE) {
+                    std::fprintf(stderr, "Invalid block size '%s': expected 100k to 64M\n", optarg);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
+            case 't': {
+                unsigned long long v;
+                if (!bw::parseCount(optarg, bw::MAX_THREADS, v)) {
+                    std::fprintf(stderr, "Invalid thread count '%s': expected 0 (all cores) to %u\n",
+                            optarg, bw::MAX_THREADS);
+                    std::exit(EXIT_FAILURE);
+                }
+                threads = v;
+                break;
+            }
+            case 'n': zero_runs = false; break;
+            case 'E':
+                if (std::strcmp(optarg, "huffman") == 0)
+                    coder = bw::Compressor::HUFFMAN;
+                else if (std::strcmp(optarg, "rans") == 0)
+                    coder = bw::Compressor::RANS;
+                else if (std::strcmp(optarg, "auto") == 0)
+                    coder = bw::Compressor::AUTO;
+                else {
+                    std::fprintf(stderr, "Unknown entropy coder '%s'\n", optarg);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
+            case 'I': {
+                unsigned long long v;
+                if (!bw::parseCount(optarg, bw::Huffman::MAX_STREAMS, v) || v == 0) {
+                    std::fprintf(stderr, "Invalid stream count '%s': expected 1 to %u\n",
+                            optarg, bw::Huffman::MAX_STREAMS);
+                    std::exit(EXIT_FAILURE);
+                }
+                streams = v;
+                break;
+            }
+            case 'x': fm_index = optarg; break;
+            case 'S':
+                stats = true;
+                if (!bw::parseStatsFormat(optarg, stats_json)) {
+                    std::fprintf(stderr, "Invalid statistics format '%s': expected text or json\n", optarg);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
+            case 'h':
+                std::cout << "Burrows-Wheeler compressor" << std::endl <<
+                    "Usage: " << basename(argv[0]) << " [-h] [-c|-d|-T] [-r offset:length] [-b size] [-t threads] [-n] [-E coder] [-I streams] [-x index] [-i in] [-o out]" << std::endl;
+                usage();
+                std::exit(EXIT_FAILURE);
+        }
+    }
+
+    if (int(encode) + int(decode) + int(test) + int(range) != 1) {
+        std::fprintf(stderr, "%s: expected exactly one of -c, -d, -T and -r\n", basename(argv[0]));
+        usage();
+        return ERROR_IN_COMMAND_LINE;
+    }
+    if (!fm_index.empty() && !encode) {
+        std::fprintf(stderr, "-x/--fm-index only applies to -c\n");
+        std::exit(EXIT_FAILURE);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    try
+    {
+        bw::Compressor compressor(block_size, threads, zero_runs, coder, streams);
+
+        // named files are mapped and written directly; otherwise standard input/output
+        if (encode)
+            compressor.compress(sif, sof, fm_index);
+        else if (range)
+            compressor.expandRange(sif, sof, range_offset, range_length);
+        else if (decode)
+            compressor.expand(sif, sof);
+        else
+            compressor.test(sif);
+    }
+    catch (const std::exception &e)
     {
-        std::cout << c.strIndex(i) << ", " << c.index(i) << std::endl;
+        std::fprintf(stderr, "%s: %s\n", basename(argv[0]), e.what());
+        return ERROR_UNHANDLED_EXCEPTION;
     }
 
+    if (stats) {
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        bw::Stats::report(stderr, stats_json, elapsed.count());
+    }
 
+    return SUCCESS;
 
-    return 0;
-}
+} // main
@@ -23,16 +23,18 @@ void bw::ostreambin::write(const char byte)
         return;
     }
 
-    // otherwise write one bit at a time
-    unsigned char c = byte;
-    for (int i = 0; i < 8; i++) {
-        bool bit = ((c >> (8 - i - 1)) & 1) == 1;
-        write(bit);
-    }
+    // otherwise complete the pending byte and keep the low bits
+    const unsigned char c = byte;
+    out_ptr->put(char((bufferOut << (8 - bufferOutBitSize)) | (c >> bufferOutBitSize)));
+    bufferOut = c & ((1 << bufferOutBitSize) - 1);
 }
 
 void bw::ostreambin::write(const char* s, const unsigned len)
 {
+    if (bufferOutBitSize == 0) {
+        out_ptr->write(s, len);
+        return;
+    }
     for (unsigned i=0; i < len; write(s[i++]));
 }
 
@@ -0,0 +1,80 @@
+#ifndef _SHARED_H_
+#define _SHARED_H_
+
+// helpers shared by the command line tools
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <string>
+#include <cstdint>
+
+namespace bw
+{
+    // parse a byte count such as "900000", "900k" or "64M"; returns 0 on error
+    inline std::size_t parseSize(const char *s)
+    {
+        if (!std::isdigit(static_cast<unsigned char>(*s)))
+            return 0;
+        char *end;
+        errno = 0;
+        const unsigned long long v = std::strtoull(s, &end, 10);
+        if (end == s || errno == ERANGE)
+            return 0;
+
+        unsigned shift = 0;
+        switch (std::tolower(*end)) {
+            case '\0':                 break;
+            case 'k': shift = 10; ++end; break;
+            case 'm': shift = 20; ++end; break;
+            case 'g': shift = 30; ++end; break;
+            default: return 0;
+        }
+        if (*end != '\0' || v > (SIZE_MAX >> shift))
+            return 0;
+        return static_cast<std::size_t>(v << shift);
+    }
+
+    // most worker threads a tool accepts
+    const unsigned MAX_THREADS = 1024;
+
+    // parse a decimal count no larger than max; returns false on anything
+    // else, signs and trailing characters included
+    inline bool parseCount(const char *s, unsigned long long max, unsigned long long &v)
+    {
+        if (!std::isdigit(static_cast<unsigned char>(*s)))
+            return false;
+        char *end;
+        errno = 0;
+        v = std::strtoull(s, &end, 10);
+        return *end == '\0' && errno != ERANGE && v <= max;
+    }
+
+    // parse OFFSET:LENGTH, each a byte count as for parseSize(); a missing
+    // length means up to the end
+    inline bool parseRange(const char *s, std::uint64_t &offset, std::uint64_t &length)
+    {
+        const char *colon = std::strchr(s, ':');
+        const std::string first = colon ? std::string(s, colon) : std::string(s);
+        offset = first == "0" ? 0 : parseSize(first.c_str());
+        if (offset == 0 && first != "0")
+            return false;
+        length = UINT64_MAX;
+        if (colon == nullptr || colon[1] == '\0')
+            return true;
+        length = parseSize(colon + 1);
+        return length != 0 || std::strcmp(colon + 1, "0") == 0;
+    }
+
+    // parse the argument of --stats: none or "text" for a table, "json" for JSON;
+    // returns false on anything else
+    inline bool parseStatsFormat(const char *s, bool &json)
+    {
+        json = s != nullptr && std::strcmp(s, "json") == 0;
+        return s == nullptr || json || std::strcmp(s, "text") == 0;
+    }
+}
+
+#endif